@@ -0,0 +1,20 @@
+#ifndef HASH_H
+
+#include "Types.h"
+
+#include <cstddef>
+
+// 64-bit FNV-1a.
+inline u64 HashBytes(const void* bytes, size_t size, u64 hash = 14695981039346656037ull)
+{
+    const u8* byte = (const u8*)bytes;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= byte[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#define HASH_H
+#endif
@@ -0,0 +1,183 @@
+#ifndef JOB_POOL_H
+
+#include "Types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// NOTE(achal): A very small pool of worker threads that pull jobs off a shared queue. The thread which calls
+// ParallelFor also participates in the work, so a pool with zero workers degrades to a plain loop.
+//
+// Background jobs (SubmitBackground), like texture loads, go in a queue of their own, which workers only get to
+// when there's nothing else queued. Threads helping out while they wait (HelpUntil) never pick up a background job,
+// a frame waiting on its tiles must not end up decoding an image.
+struct JobPool
+{
+    ~JobPool()
+    {
+        Shutdown();
+    }
+
+    // Passing 0 for the worker count picks one worker per hardware thread, minus the calling thread.
+    void Initialize(u32 worker_count = 0)
+    {
+        if (worker_count == 0)
+        {
+            u32 hardware_thread_count = std::thread::hardware_concurrency();
+            worker_count = hardware_thread_count > 1 ? hardware_thread_count - 1 : 0;
+        }
+
+        running = true;
+        workers.reserve(worker_count);
+        for (u32 i = 0; i < worker_count; ++i)
+            workers.emplace_back([this] { WorkerLoop(); });
+    }
+
+    void Shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        job_available.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    inline u32 GetThreadCount() const
+    {
+        return (u32)workers.size() + 1;
+    }
+
+    // Queues a job for the workers. A pool without workers runs it right away on the calling thread, otherwise
+    // nothing would ever pick it up.
+    void Submit(std::function<void()> job)
+    {
+        if (workers.empty())
+        {
+            job();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        job_available.notify_one();
+    }
+
+    // Queues a job that nobody waits on, to run whenever a worker has nothing else to do. Same as Submit for a pool
+    // without workers.
+    void SubmitBackground(std::function<void()> job)
+    {
+        if (workers.empty())
+        {
+            job();
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            background_jobs.push_back(std::move(job));
+        }
+        job_available.notify_one();
+    }
+
+    // Calls fn(i) for every i in [0, count) spread across the pool and returns once all of them have finished.
+    template <typename Function>
+    void ParallelFor(u32 count, const Function& fn)
+    {
+        if (count == 0)
+            return;
+
+        std::atomic<u32> next_index(0);
+        auto drain = [&]()
+        {
+            u32 i;
+            while ((i = next_index.fetch_add(1)) < count)
+                fn(i);
+        };
+
+        u32 helper_count = (u32)workers.size() < count - 1 ? (u32)workers.size() : count - 1;
+        std::atomic<u32> finished_helper_count(0);
+        for (u32 i = 0; i < helper_count; ++i)
+        {
+            Submit([&]()
+            {
+                drain();
+                finished_helper_count.fetch_add(1);
+            });
+        }
+
+        drain();
+
+        // NOTE(achal): Every helper references our locals, so we can't return before all of them have run, even
+        // the ones that will find nothing left to do.
+        HelpUntil([&]() { return finished_helper_count.load() == helper_count; });
+    }
+
+    // Returns once done() does, running whatever is queued in the meantime instead of just blocking. Except for
+    // background jobs, see SubmitBackground.
+    template <typename Predicate>
+    void HelpUntil(const Predicate& done)
+    {
+        while (!done())
+        {
+            if (!RunOneJob())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                job_available.wait(lock, [this] { return !running || !jobs.empty() || !background_jobs.empty(); });
+                if (!running && jobs.empty() && background_jobs.empty())
+                    return;
+
+                std::deque<std::function<void()>>& queue = jobs.empty() ? background_jobs : jobs;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            job();
+        }
+    }
+
+    // Runs a single queued job on the calling thread, if there is one, never a background one.
+    b32 RunOneJob()
+    {
+        std::function<void()> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (jobs.empty())
+                return false;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+        return true;
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::deque<std::function<void()>> background_jobs;
+    std::mutex mutex;
+    std::condition_variable job_available;
+    b32 running = false;
+};
+
+#define JOB_POOL_H
+#endif
@@ -0,0 +1,108 @@
+#ifndef MAPPED_FILE_H
+
+#include "Types.h"
+
+#include <cstddef>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+// NOTE(achal): This header ends up in most of the tree through Texture.h, windows.h's min and max macros would break
+// every std::min, std::max, glm::min and glm::max after it.
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// NOTE(achal): A read-only view of a whole file. The OS pages it in on first touch and can drop the pages again
+// under memory pressure since they are backed by the file itself, so mapping a file costs next to nothing until
+// its contents are actually read.
+struct MappedFile
+{
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    b32 Open(const char* path)
+    {
+        Close();
+
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping)
+            return false;
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view)
+            return false;
+
+        data = (const u8*)view;
+        size = (size_t)file_size.QuadPart;
+#else
+        int file = open(path, O_RDONLY);
+        if (file == -1)
+            return false;
+
+        struct stat file_stat;
+        if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+        {
+            close(file);
+            return false;
+        }
+
+        void* view = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (view == MAP_FAILED)
+            return false;
+
+        data = (const u8*)view;
+        size = (size_t)file_stat.st_size;
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+        if (!data)
+            return;
+
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void*)data, size);
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    const u8* data = NULL;
+    size_t size = 0;
+};
+
+#define MAPPED_FILE_H
+#endif
@@ -5,6 +5,10 @@ typedef uint32_t b32;
 
 typedef uint8_t u8;
 typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef int32_t s32;
+typedef int64_t s64;
 
 typedef float f32;
 
@@ -4,6 +4,7 @@
 #include "Scene.h"
 #include "IndexedTriangleList.h"
 #include "Pipeline.h"
+#include "DepthPipeline.h"
 #include "TextureEffect.h"
 
 #include <glm/glm.hpp>
@@ -11,6 +12,7 @@
 struct CubeSkinScene : public Scene
 {
     typedef Pipeline<TextureEffect> Pipeline;
+    typedef DepthPipeline<TextureEffect> DepthPipeline;
     typedef Pipeline::Vertex Vertex;
 
     CubeSkinScene()
@@ -86,6 +88,18 @@ struct CubeSkinScene : public Scene
         pipeline.Draw(it_list);
     }
 
+    void DrawDepth() override
+    {
+        depth_pipeline.vertex_shader = pipeline.effect.vertex_shader;
+        depth_pipeline.Draw(it_list);
+    }
+
+    void EndFrame() override
+    {
+        pipeline.EndFrame();
+        depth_pipeline.EndFrame();
+    }
+
     void SetFramebuffer(Framebuffer* framebuffer) override
     {
         pipeline.framebuffer = framebuffer;
@@ -94,6 +108,42 @@ struct CubeSkinScene : public Scene
     void SetZBuffer(ZBuffer* z_buffer) override
     {
         pipeline.z_buffer = z_buffer;
+        depth_pipeline.z_buffer = z_buffer;
+    }
+
+    void SetTileTracker(DirtyTileTracker* tile_tracker) override
+    {
+        pipeline.tile_tracker = tile_tracker;
+        depth_pipeline.tile_tracker = tile_tracker;
+    }
+
+    void SetRenderQueue(RenderQueue* render_queue) override
+    {
+        pipeline.render_queue = render_queue;
+        depth_pipeline.render_queue = render_queue;
+    }
+
+    void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) override
+    {
+        pipeline.occlusion_buffer = occlusion_buffer;
+        depth_pipeline.occlusion_buffer = occlusion_buffer;
+    }
+
+    void SetDepthTest(DepthTest depth_test) override
+    {
+        pipeline.depth_test = depth_test;
+    }
+
+    void SetViewport(const ScreenRect& viewport) override
+    {
+        pipeline.viewport = viewport;
+        depth_pipeline.viewport = viewport;
+    }
+
+    void SetScissor(const ScreenRect& scissor) override
+    {
+        pipeline.scissor = scissor;
+        depth_pipeline.scissor = scissor;
     }
 
     void SetModel(const glm::mat4& model) override
@@ -103,6 +153,7 @@ struct CubeSkinScene : public Scene
 
     IndexedTriangleList<Vertex> it_list;
     Pipeline pipeline;
+    DepthPipeline depth_pipeline;
 };
 
 #define CUBE_SKIN_SCENE_H
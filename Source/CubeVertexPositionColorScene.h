@@ -2,6 +2,7 @@
 
 #include "Scene.h"
 #include "Pipeline.h"
+#include "DepthPipeline.h"
 #include "IndexedTriangleList.h"
 #include "VertexPositionColorEffect.h"
 
@@ -10,6 +11,7 @@
 struct CubeVertexPositionColorScene : public Scene
 {
     typedef Pipeline<VertexPositionColorEffect> Pipeline;
+    typedef DepthPipeline<VertexPositionColorEffect> DepthPipeline;
     typedef Pipeline::Vertex Vertex;
 
     CubeVertexPositionColorScene()
@@ -53,6 +55,18 @@ struct CubeVertexPositionColorScene : public Scene
         pipeline.Draw(it_list);
     }
 
+    void DrawDepth() override
+    {
+        depth_pipeline.vertex_shader = pipeline.effect.vertex_shader;
+        depth_pipeline.Draw(it_list);
+    }
+
+    void EndFrame() override
+    {
+        pipeline.EndFrame();
+        depth_pipeline.EndFrame();
+    }
+
     void SetFramebuffer(Framebuffer* framebuffer) override
     {
         pipeline.framebuffer = framebuffer;
@@ -61,6 +75,42 @@ struct CubeVertexPositionColorScene : public Scene
     void SetZBuffer(ZBuffer* z_buffer) override
     {
         pipeline.z_buffer = z_buffer;
+        depth_pipeline.z_buffer = z_buffer;
+    }
+
+    void SetTileTracker(DirtyTileTracker* tile_tracker) override
+    {
+        pipeline.tile_tracker = tile_tracker;
+        depth_pipeline.tile_tracker = tile_tracker;
+    }
+
+    void SetRenderQueue(RenderQueue* render_queue) override
+    {
+        pipeline.render_queue = render_queue;
+        depth_pipeline.render_queue = render_queue;
+    }
+
+    void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) override
+    {
+        pipeline.occlusion_buffer = occlusion_buffer;
+        depth_pipeline.occlusion_buffer = occlusion_buffer;
+    }
+
+    void SetDepthTest(DepthTest depth_test) override
+    {
+        pipeline.depth_test = depth_test;
+    }
+
+    void SetViewport(const ScreenRect& viewport) override
+    {
+        pipeline.viewport = viewport;
+        depth_pipeline.viewport = viewport;
+    }
+
+    void SetScissor(const ScreenRect& scissor) override
+    {
+        pipeline.scissor = scissor;
+        depth_pipeline.scissor = scissor;
     }
 
     void SetModel(const glm::mat4& model) override
@@ -70,6 +120,7 @@ struct CubeVertexPositionColorScene : public Scene
 
     IndexedTriangleList<Vertex> it_list;
     Pipeline pipeline;
+    DepthPipeline depth_pipeline;
 };
 
 #define CUBE_VERTEX_POSITION_COLOR_SCENE_H
@@ -1,5 +1,7 @@
 #ifndef DEFAULT_VERTEX_SHADER_H
 
+#include "Core/Types.h"
+
 #include <glm/glm.hpp>
 
 template <typename Vertex>
@@ -12,10 +14,18 @@ struct DefaultVertexShader
         model = m;
     }
 
+    static const b32 transforms_positions = true;
+    static const b32 transforms_affinely = true;
+
+    glm::vec3 TransformPosition(const Vertex& v) const
+    {
+        return glm::vec3(model * glm::vec4(v.position, 1.f));
+    }
+
     VertexOut operator () (const Vertex& v) const
     {
         VertexOut result;
-        result.position = glm::vec3(model * glm::vec4(v.position, 1.f));
+        result.position = TransformPosition(v);
         result.CopyAttributesFrom(v);
         return result;
     }
@@ -0,0 +1,451 @@
+#ifndef DEPTH_PIPELINE_H
+
+#include "Core/Types.h"
+#include "Core/Hash.h"
+#include "DirtyTileTracker.h"
+#include "EdgeEquation.h"
+#include "IndexedTriangleList.h"
+#include "OcclusionBuffer.h"
+#include "Pipeline.h"
+#include "RenderQueue.h"
+#include "ZBuffer.h"
+#include "ScreenRect.h"
+
+#include <glm/glm.hpp>
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// NOTE(achal): Vertex shaders which declare `static const b32 transforms_positions = true;` also have
+// TransformPosition(v), returning just the position operator() would, so the DepthPipeline doesn't have to compute
+// the rest of the attributes only to throw them away. Everybody else gets run in full.
+template <typename VertexShader, typename = void>
+struct TransformsPositions : std::false_type {};
+
+template <typename VertexShader>
+struct TransformsPositions<VertexShader, typename std::enable_if<VertexShader::transforms_positions>::type> : std::true_type {};
+
+// NOTE(achal): A Pipeline cut down to what it takes to fill a depth buffer, for shadow maps, depth pre-passes and
+// occlusion buffers. It runs the positions of the effect's vertex shader through the same culling, snapping and
+// setup, then rasterizes nothing but 1 / depth: no other attributes, no geometry shader (none of them move
+// vertices), no pixel shader and no framebuffer.
+//
+// Depth is computed with exactly the operations the Pipeline uses for position.z, so both write bit-identical depth
+// for the same mesh and vertex shader uniforms, which is what lets a depth pre-pass be followed by an equality test.
+template <typename Effect>
+struct DepthPipeline
+{
+    typedef typename Effect::Vertex Vertex;
+    typedef typename Effect::VertexShader VertexShader;
+
+    // NOTE(achal): The depth-only counterpart of Pipeline::ScreenTriangle.
+    struct DepthTriangle
+    {
+        // NOTE(achal): Screen space, z is 1 / depth.
+        glm::vec3 positions[3];
+
+        ScreenRect bounds;
+        EdgeEquation edges[3];
+
+        // NOTE(achal): Screen-space gradients of 1 / depth.
+        f32 gradient_x;
+        f32 gradient_y;
+
+        // NOTE(achal): Depth is clamped to at least this, see SetupTriangle.
+        f32 min_z;
+
+        // NOTE(achal): HashBytes of positions.
+        u64 hash;
+    };
+
+    // NOTE(achal): Same stages as Pipeline::Draw, minus the ones that only matter for color.
+    void Draw(const IndexedTriangleList<Vertex>& it_list)
+    {
+        if (occlusion_buffer && occlusion_buffer->IsOccluded(it_list, vertex_shader))
+            return;
+
+        std::shared_ptr<const std::vector<DepthTriangle>> triangles = GetDepthTriangles(it_list);
+        if (triangles->empty())
+            return;
+
+        if (!render_queue)
+        {
+            Submit(triangles);
+            return;
+        }
+
+        f32 nearest_z = 0.f;
+        for (const DepthTriangle& depth_triangle : *triangles)
+        {
+            const glm::vec3* p = depth_triangle.positions;
+            nearest_z = std::max(nearest_z, std::max(p[0].z, std::max(p[1].z, p[2].z)));
+        }
+
+        render_queue->Add(RENDER_QUEUE_LAYER_DEPTH, 1.f / nearest_z, [this, triangles]() { Submit(triangles); });
+    }
+
+    void Submit(const std::shared_ptr<const std::vector<DepthTriangle>>& triangles)
+    {
+        if (!tile_tracker)
+        {
+            ScreenRect clip_rect = { 0, 0, (int)z_buffer->width, (int)z_buffer->height };
+            for (const DepthTriangle& depth_triangle : *triangles)
+                DrawTriangle(depth_triangle, clip_rect);
+            return;
+        }
+
+        const DepthPipeline* pipeline = this;
+        u64 state_signature = HashBytes(&pipeline, sizeof(pipeline));
+        state_signature = HashBytes(&coverage_rule, sizeof(coverage_rule), state_signature);
+        ScreenRect clip_rect = GetClipRect();
+        state_signature = HashBytes(&clip_rect, sizeof(clip_rect), state_signature);
+
+        u32 draw_index = tile_tracker->AddDraw([this, triangles](const ScreenRect& rect,
+            const DirtyTileTracker::BinEntry* entries, u32 count)
+        {
+            for (u32 i = 0; i < count; ++i)
+                DrawTriangle((*triangles)[entries[i].triangle_index], rect);
+        });
+
+        for (u32 i = 0; i < (u32)triangles->size(); ++i)
+        {
+            const DepthTriangle& depth_triangle = (*triangles)[i];
+            u64 triangle_hash = HashBytes(&state_signature, sizeof(state_signature), depth_triangle.hash);
+            tile_tracker->AddTriangle(depth_triangle.bounds, triangle_hash, draw_index, i);
+        }
+    }
+
+    // Same as Pipeline::GetScreenTriangles.
+    std::shared_ptr<const std::vector<DepthTriangle>> GetDepthTriangles(const IndexedTriangleList<Vertex>& it_list)
+    {
+        u64 key = HashBytes(&it_list.version, sizeof(it_list.version));
+        size_t counts[2] = { it_list.vertices.size(), it_list.indices.size() };
+        key = HashBytes(counts, sizeof(counts), key);
+        key = Pipeline<Effect>::HashUniforms(vertex_shader, key, std::is_empty<VertexShader>());
+        u32 z_buffer_format[3] = { z_buffer->width, z_buffer->height, z_buffer->sample_count };
+        key = HashBytes(z_buffer_format, sizeof(z_buffer_format), key);
+        key = HashBytes(&coverage_rule, sizeof(coverage_rule), key);
+        ScreenRect draw_rects[2] = { GetViewport(), GetClipRect() };
+        key = HashBytes(draw_rects, sizeof(draw_rects), key);
+
+        DrawCache& cache = draw_caches[it_list.id];
+        cache.is_used = true;
+        if (cache.triangles && cache.key == key)
+            return cache.triangles;
+
+        if (!cache.triangles || cache.triangles.use_count() > 1)
+            cache.triangles = std::make_shared<std::vector<DepthTriangle>>();
+        cache.key = key;
+
+        std::vector<DepthTriangle>& triangles = *cache.triangles;
+        triangles.clear();
+
+        transformed_positions.resize(it_list.vertices.size());
+        for (size_t i = 0; i < it_list.vertices.size(); ++i)
+            transformed_positions[i] = TransformPosition(it_list.vertices[i], TransformsPositions<VertexShader>());
+
+        for (size_t i = 0; i < it_list.indices.size() / 3; ++i)
+        {
+            const glm::vec3& p0 = transformed_positions[it_list.indices[3 * i]];
+            const glm::vec3& p1 = transformed_positions[it_list.indices[3 * i + 1]];
+            const glm::vec3& p2 = transformed_positions[it_list.indices[3 * i + 2]];
+
+            b32 should_cull = (glm::dot(glm::cross(p1 - p0, p2 - p0), p1)) >= 0;
+            if (should_cull)
+                continue;
+
+            DepthTriangle depth_triangle;
+            depth_triangle.positions[0] = p0;
+            depth_triangle.positions[1] = p1;
+            depth_triangle.positions[2] = p2;
+            for (int j = 0; j < 3; ++j)
+                ToScreenSpace(&depth_triangle.positions[j], draw_rects[0]);
+
+            if (SetupTriangle(&depth_triangle, draw_rects[1]))
+                triangles.push_back(depth_triangle);
+        }
+
+        return cache.triangles;
+    }
+
+    // Same as Pipeline::EndFrame.
+    void EndFrame()
+    {
+        for (auto it = draw_caches.begin(); it != draw_caches.end();)
+        {
+            if (it->second.is_used)
+            {
+                it->second.is_used = false;
+                ++it;
+            }
+            else
+            {
+                it = draw_caches.erase(it);
+            }
+        }
+    }
+
+    inline glm::vec3 TransformPosition(const Vertex& v, std::true_type)
+    {
+        return vertex_shader.TransformPosition(v);
+    }
+
+    inline glm::vec3 TransformPosition(const Vertex& v, std::false_type)
+    {
+        return vertex_shader(v).position;
+    }
+
+    b32 SetupTriangle(DepthTriangle* depth_triangle, const ScreenRect& clip_rect)
+    {
+        const glm::vec3* p = depth_triangle->positions;
+
+        f32 x[3] = { p[0].x, p[1].x, p[2].x };
+        f32 y[3] = { p[0].y, p[1].y, p[2].y };
+        if (!SetupEdges(x, y, (int)z_buffer->sample_count, coverage_rule, depth_triangle->edges,
+            &depth_triangle->bounds))
+            return false;
+
+        depth_triangle->bounds = Intersect(depth_triangle->bounds, clip_rect);
+        if (IsEmpty(depth_triangle->bounds))
+            return false;
+
+        // NOTE(achal): Pipeline::ComputeGradients, for z only.
+        f32 dx1 = p[1].x - p[0].x;
+        f32 dy1 = p[1].y - p[0].y;
+        f32 dx2 = p[2].x - p[0].x;
+        f32 dy2 = p[2].y - p[0].y;
+
+        f32 d1 = p[1].z - p[0].z;
+        f32 d2 = p[2].z - p[0].z;
+
+        f32 area = dx1 * dy2 - dx2 * dy1;
+        if (area == 0.f)
+        {
+            depth_triangle->gradient_x = d1 * 0.f;
+            depth_triangle->gradient_y = d1 * 0.f;
+        }
+        else
+        {
+            f32 rcp_area = 1.f / area;
+            depth_triangle->gradient_x = (d1 * dy2 - d2 * dy1) * rcp_area;
+            depth_triangle->gradient_y = (d2 * dx1 - d1 * dx2) * rcp_area;
+        }
+
+        // NOTE(achal): 1 / depth is linear on screen, over a pixel it's smallest at one of the pixel's corners and
+        // largest at the opposite one, half a pixel from the center either way. Moving v0's by that much moves the
+        // whole plane, and every pixel gets the depth of its farthest corner when underestimating coverage, of its
+        // nearest when overestimating. The nearest corner may be outside the triangle then, the depth never gets any
+        // nearer than the triangle's nearest vertex though.
+        depth_triangle->min_z = 0.f;
+        if (coverage_rule != COVERAGE_RULE_CENTER)
+        {
+            f32 corner_offset = 0.5f * (std::fabs(depth_triangle->gradient_x) + std::fabs(depth_triangle->gradient_y));
+            if (coverage_rule == COVERAGE_RULE_UNDERESTIMATE)
+            {
+                depth_triangle->positions[0].z -= corner_offset;
+            }
+            else
+            {
+                depth_triangle->min_z = 1.f / std::max(p[0].z, std::max(p[1].z, p[2].z));
+                depth_triangle->positions[0].z += corner_offset;
+            }
+        }
+
+        depth_triangle->hash = HashBytes(p, sizeof(depth_triangle->positions));
+        return true;
+    }
+
+    void DrawTriangle(const DepthTriangle& depth_triangle, const ScreenRect& clip_rect)
+    {
+        int x_min = std::max(depth_triangle.bounds.min_x, clip_rect.min_x);
+        int x_max = std::min(depth_triangle.bounds.max_x, clip_rect.max_x);
+        int y_min = std::max(depth_triangle.bounds.min_y, clip_rect.min_y);
+        int y_max = std::min(depth_triangle.bounds.max_y, clip_rect.max_y);
+        if (x_min >= x_max || y_min >= y_max)
+            return;
+
+        if (z_buffer->sample_count > 1)
+        {
+            ScreenRect rect = { x_min, y_min, x_max, y_max };
+            DrawMultisampled(rect, depth_triangle);
+            return;
+        }
+
+        const EdgeEquation* edges = depth_triangle.edges;
+        s64 row_values[3];
+        for (int i = 0; i < 3; ++i)
+            row_values[i] = edges[i].b * y_min + edges[i].c;
+
+        for (int y = y_min; y < y_max; ++y)
+        {
+            int start = x_min;
+            int end = x_max;
+            for (int i = 0; i < 3; ++i)
+            {
+                ClipSpanToEdge(edges[i], row_values[i], &start, &end);
+                row_values[i] += edges[i].b;
+            }
+
+            if (start < end)
+                DrawSpan(y, start, end, depth_triangle);
+        }
+    }
+
+    // NOTE(achal): The whole inner loop: interpolate, divide, depth test, four pixels at a time.
+    void DrawSpan(int y, int start, int end, const DepthTriangle& depth_triangle)
+    {
+        const glm::vec3& v0 = depth_triangle.positions[0];
+        f32 row_origin = v0.z + depth_triangle.gradient_y * ((f32)y + 0.5f - v0.y);
+        f32* depth = z_buffer->GetRow((u32)y);
+
+        __m128 row_origin_x4 = _mm_set1_ps(row_origin);
+        __m128 gradient_x4 = _mm_set1_ps(depth_triangle.gradient_x);
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 v0_x = _mm_set1_ps(v0.x);
+        __m128 one = _mm_set1_ps(1.f);
+        __m128 min_z = _mm_set1_ps(depth_triangle.min_z);
+        __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+
+        int x = start;
+        for (; x + 4 <= end; x += 4)
+        {
+            __m128 pixel_x = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x), lanes));
+            __m128 offset = _mm_sub_ps(_mm_add_ps(pixel_x, half), v0_x);
+            __m128 z = _mm_div_ps(one, _mm_add_ps(row_origin_x4, _mm_mul_ps(gradient_x4, offset)));
+            z = _mm_max_ps(min_z, z);
+
+            __m128 old_z = _mm_loadu_ps(depth + x);
+            __m128 pass = _mm_cmplt_ps(z, old_z);
+            _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old_z)));
+        }
+
+        for (; x < end; ++x)
+        {
+            f32 z = 1.f / (row_origin + depth_triangle.gradient_x * ((f32)x + 0.5f - v0.x));
+            z = z < depth_triangle.min_z ? depth_triangle.min_z : z;
+            depth[x] = z < depth[x] ? z : depth[x];
+        }
+    }
+
+    // Same as Pipeline::DrawMultisampled, with each sample's depth tested right where its span is found.
+    void DrawMultisampled(const ScreenRect& rect, const DepthTriangle& depth_triangle)
+    {
+        const EdgeEquation* edges = depth_triangle.edges;
+        s64 row_values[MSAA_SAMPLE_COUNT][3];
+        f32 sample_z_offsets[MSAA_SAMPLE_COUNT];
+        for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+        {
+            for (int i = 0; i < 3; ++i)
+                row_values[sample][i] = edges[i].b * rect.min_y + edges[i].c + GetSampleEdgeOffset(edges[i], sample);
+
+            sample_z_offsets[sample] = (depth_triangle.gradient_x * (f32)msaa_sample_offsets[sample][0] +
+                depth_triangle.gradient_y * (f32)msaa_sample_offsets[sample][1]) / 16.f;
+        }
+
+        const glm::vec3& v0 = depth_triangle.positions[0];
+        for (int y = rect.min_y; y < rect.max_y; ++y)
+        {
+            f32 row_origin = v0.z + depth_triangle.gradient_y * ((f32)y + 0.5f - v0.y);
+            f32* depth = z_buffer->GetRow((u32)y);
+
+            for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+            {
+                int start = rect.min_x;
+                int end = rect.max_x;
+                for (int i = 0; i < 3; ++i)
+                {
+                    ClipSpanToEdge(edges[i], row_values[sample][i], &start, &end);
+                    row_values[sample][i] += edges[i].b;
+                }
+
+                for (int x = start; x < end; ++x)
+                {
+                    f32 pixel_z = row_origin + depth_triangle.gradient_x * ((f32)x + 0.5f - v0.x);
+                    f32 z = 1.f / (pixel_z + sample_z_offsets[sample]);
+                    f32* sample_depth = depth + x * MSAA_SAMPLE_COUNT + sample;
+                    *sample_depth = z < *sample_depth ? z : *sample_depth;
+                }
+            }
+        }
+    }
+
+    // Same as Pipeline::GetViewport and Pipeline::GetClipRect, with the z buffer for a framebuffer.
+    inline ScreenRect GetViewport() const
+    {
+        ScreenRect z_buffer_rect = { 0, 0, (int)z_buffer->width, (int)z_buffer->height };
+        return IsEmpty(viewport) ? z_buffer_rect : viewport;
+    }
+
+    inline ScreenRect GetClipRect() const
+    {
+        ScreenRect z_buffer_rect = { 0, 0, (int)z_buffer->width, (int)z_buffer->height };
+        ScreenRect clip_rect = Intersect(GetViewport(), z_buffer_rect);
+        return IsEmpty(scissor) ? clip_rect : Intersect(clip_rect, scissor);
+    }
+
+    // Same as Pipeline::ToScreenSpace, for the position alone.
+    inline static void ToScreenSpace(glm::vec3* position, const ScreenRect& draw_viewport)
+    {
+        f32 rcp_abs_z = 1.f / glm::abs(position->z);
+        *position *= rcp_abs_z;
+
+        f32 half_width = (f32)(draw_viewport.max_x - draw_viewport.min_x) / 2.f;
+        f32 half_height = (f32)(draw_viewport.max_y - draw_viewport.min_y) / 2.f;
+        position->x = (f32)draw_viewport.min_x + (position->x + 1.f) * half_width;
+        position->y = (f32)draw_viewport.min_y + (-position->y + 1.f) * half_height;
+        position->z = rcp_abs_z;
+    }
+
+    VertexShader vertex_shader;
+    ZBuffer* z_buffer;
+    DirtyTileTracker* tile_tracker = NULL;
+    RenderQueue* render_queue = NULL;
+    OcclusionBuffer* occlusion_buffer = NULL;
+
+    // NOTE(achal): Same as Pipeline::viewport and Pipeline::scissor, a depth pre-pass needs the same ones.
+    ScreenRect viewport = {};
+    ScreenRect scissor = {};
+
+    // NOTE(achal): Single sampled z buffers only, for anything other than COVERAGE_RULE_CENTER. Conservative rules
+    // write the depth of the corner of each pixel that is conservative the same way, COVERAGE_RULE_UNDERESTIMATE
+    // for drawing occluders into an OcclusionBuffer: only the pixels a triangle covers entirely, at the farthest depth
+    // the triangle has within them. Never more occlusion than there is.
+    CoverageRule coverage_rule = COVERAGE_RULE_CENTER;
+
+    // NOTE(achal): Same as Pipeline::draw_caches.
+    struct DrawCache
+    {
+        u64 key;
+        std::shared_ptr<std::vector<DepthTriangle>> triangles;
+        b32 is_used = false;
+    };
+    std::unordered_map<u64, DrawCache> draw_caches;
+
+    std::vector<glm::vec3> transformed_positions;
+};
+
+// NOTE(achal): Draws it_list, with occluder_pipeline's vertex shader, into occlusion_buffer as an occluder, see
+// OcclusionBuffer. Right away and straight into its z buffer: no tile tracker, no render queue, no viewport or
+// scissor other than the whole occlusion buffer, and COVERAGE_RULE_UNDERESTIMATE. The pipeline should be one the
+// scene keeps for its occluders alone, so that what it holds on to for them stays put from frame to frame.
+template <typename Effect>
+inline void DrawOccluder(DepthPipeline<Effect>* occluder_pipeline, OcclusionBuffer* occlusion_buffer,
+    const IndexedTriangleList<typename Effect::Vertex>& it_list)
+{
+    occluder_pipeline->z_buffer = &occlusion_buffer->z_buffer;
+    occluder_pipeline->tile_tracker = NULL;
+    occluder_pipeline->render_queue = NULL;
+    occluder_pipeline->occlusion_buffer = NULL;
+    occluder_pipeline->viewport = {};
+    occluder_pipeline->scissor = {};
+    occluder_pipeline->coverage_rule = COVERAGE_RULE_UNDERESTIMATE;
+    occluder_pipeline->Draw(it_list);
+}
+
+#define DEPTH_PIPELINE_H
+#endif
@@ -0,0 +1,250 @@
+#ifndef DIRTY_TILE_TRACKER_H
+
+#include "Core/Types.h"
+#include "Core/JobPool.h"
+#include "ScreenRect.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define DIRTY_TILE_SIZE 64
+
+// NOTE(achal): The back half of a sort-middle renderer. The screen is split into DIRTY_TILE_SIZE x DIRTY_TILE_SIZE
+// tiles, pipelines run the geometry stages and bin every screen space triangle they would draw into the tiles it
+// touches, and the tiles then get rasterized independently of each other on the job pool.
+//
+// Along the way it keeps track of what every tile depends on, so that only the tiles whose contents actually changed
+// get cleared and rasterized again. Each tile's signature is an order dependent mix of the hashes of all the
+// triangles binned into it, each hash covering everything that determines the triangle's pixels. SubmitDirtyTiles
+// compares the signatures against the ones the target buffer was last drawn with and only rasterizes the tiles that
+// differ. Tiles nobody touched keep whatever the target buffer already holds. A frame that is the same as the last
+// one drawn doesn't need a target buffer at all, see IsFrameUnchanged.
+//
+// Every buffer drawn into is remembered by address, so the back buffers of a swap chain, which each hold an older
+// frame, are brought up to date on their own.
+//
+// Two frames live here at once: the one being binned and the one being rasterized. Once a frame is submitted its
+// bins and draws move aside, so the caller can go on to run the geometry of the next frame while the pool is
+// still busy with the tiles of this one. It has to WaitForTiles before submitting again though, one frame in flight
+// is all there's room for.
+struct DirtyTileTracker
+{
+    // NOTE(achal): A triangle binned into a tile, by the deferred draw it came from and its index within that draw.
+    struct BinEntry
+    {
+        u32 draw_index;
+        u32 triangle_index;
+    };
+
+    // Rasterizes the count triangles of entries, all of them from this draw, only the parts of them inside rect.
+    // Called from any thread of the pool, with a different rect each time.
+    typedef std::function<void(const ScreenRect& rect, const BinEntry* entries, u32 count)> DeferredDraw;
+    typedef std::function<void(const ScreenRect& rect)> TileFunction;
+
+    void Initialize(int width, int height)
+    {
+        this->width = width;
+        this->height = height;
+        tile_count_x = (width + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+        tile_count_y = (height + DIRTY_TILE_SIZE - 1) / DIRTY_TILE_SIZE;
+
+        size_t tile_count = (size_t)tile_count_x * (size_t)tile_count_y;
+        tile_signatures.assign(tile_count, 0);
+        binning.bins.resize(tile_count);
+        rasterizing.bins.resize(tile_count);
+        Invalidate();
+    }
+
+    // Forgets the contents of every buffer, the next frame gets drawn in full.
+    void Invalidate()
+    {
+        buffer_signatures.clear();
+        drawn_signatures.clear();
+    }
+
+    // Starts a new frame. Everything that affects every pixel, like the clear color, goes into seed.
+    void BeginFrame(u64 seed)
+    {
+        std::fill(tile_signatures.begin(), tile_signatures.end(), seed);
+
+        binning.draws.clear();
+        for (std::vector<BinEntry>& bin : binning.bins)
+            bin.clear();
+    }
+
+    // Registers a draw to be replayed, in the order of registration, for every tile that needs it. Returns the index
+    // AddTriangle wants for the draw's triangles.
+    u32 AddDraw(DeferredDraw draw)
+    {
+        binning.draws.push_back(std::move(draw));
+        return (u32)binning.draws.size() - 1;
+    }
+
+    // Bins triangle triangle_index of draw draw_index, covering pixels within bounds at most, into every tile the
+    // bounds touch and adds its hash to their signatures.
+    inline void AddTriangle(const ScreenRect& bounds, u64 triangle_hash, u32 draw_index, u32 triangle_index)
+    {
+        int min_x = std::max(bounds.min_x, 0);
+        int min_y = std::max(bounds.min_y, 0);
+        int max_x = std::min(bounds.max_x, width);
+        int max_y = std::min(bounds.max_y, height);
+        if (min_x >= max_x || min_y >= max_y)
+            return;
+
+        int tile_min_x = min_x / DIRTY_TILE_SIZE;
+        int tile_min_y = min_y / DIRTY_TILE_SIZE;
+        int tile_max_x = (max_x - 1) / DIRTY_TILE_SIZE;
+        int tile_max_y = (max_y - 1) / DIRTY_TILE_SIZE;
+
+        BinEntry entry = { draw_index, triangle_index };
+        for (int tile_y = tile_min_y; tile_y <= tile_max_y; ++tile_y)
+        {
+            size_t row = (size_t)tile_y * (size_t)tile_count_x;
+            for (int tile_x = tile_min_x; tile_x <= tile_max_x; ++tile_x)
+            {
+                u64& signature = tile_signatures[row + tile_x];
+                signature = (signature ^ triangle_hash) * 1099511628211ull;
+                binning.bins[row + tile_x].push_back(entry);
+            }
+        }
+    }
+
+    // True if the current frame is exactly the last one submitted, which is then still the one on screen.
+    inline b32 IsFrameUnchanged() const
+    {
+        return drawn_signatures == tile_signatures;
+    }
+
+    // Starts bringing the buffer at target up to date with the current frame: every stale tile is passed to clear,
+    // then to the deferred draws of the triangles binned into it and last to resolve, if there is one, on job_pool.
+    // Returns right away with the number of tiles submitted. Neither the target nor anything else the draws write to
+    // may be touched until WaitForTiles returns.
+    u32 SubmitDirtyTiles(JobPool* job_pool, const void* target, TileFunction clear, TileFunction resolve = TileFunction())
+    {
+        assert(finished_job_count.load() == job_count);
+
+        std::swap(binning, rasterizing);
+        rasterizing.clear = std::move(clear);
+        rasterizing.resolve = std::move(resolve);
+        rasterizing.dirty_tiles.clear();
+
+        auto target_it = buffer_signatures.find(target);
+        if (target_it == buffer_signatures.end())
+        {
+            for (u32 tile = 0; tile < (u32)tile_signatures.size(); ++tile)
+                rasterizing.dirty_tiles.push_back(tile);
+
+            buffer_signatures.emplace(target, tile_signatures);
+        }
+        else
+        {
+            std::vector<u64>& target_signatures = target_it->second;
+            for (u32 tile = 0; tile < (u32)tile_signatures.size(); ++tile)
+            {
+                if (target_signatures[tile] != tile_signatures[tile])
+                    rasterizing.dirty_tiles.push_back(tile);
+            }
+
+            target_signatures = tile_signatures;
+        }
+        drawn_signatures = tile_signatures;
+
+        // NOTE(achal): One job per thread, each pulling tiles off the list until it runs dry.
+        u32 dirty_tile_count = (u32)rasterizing.dirty_tiles.size();
+        job_count = std::min(job_pool->GetThreadCount(), dirty_tile_count);
+        next_dirty_tile.store(0);
+        finished_job_count.store(0);
+        for (u32 i = 0; i < job_count; ++i)
+        {
+            job_pool->Submit([this]()
+            {
+                RasterizeTiles();
+                finished_job_count.fetch_add(1, std::memory_order_release);
+            });
+        }
+
+        return dirty_tile_count;
+    }
+
+    // Returns once every tile of the last SubmitDirtyTiles is done, helping out with them in the meantime.
+    void WaitForTiles(JobPool* job_pool)
+    {
+        job_pool->HelpUntil([this]() { return finished_job_count.load(std::memory_order_acquire) == job_count; });
+
+        // NOTE(achal): Let go of whatever the draws hold on to as early as possible.
+        rasterizing.draws.clear();
+    }
+
+private:
+    void RasterizeTiles()
+    {
+        u32 i;
+        while ((i = next_dirty_tile.fetch_add(1)) < (u32)rasterizing.dirty_tiles.size())
+            RasterizeTile(rasterizing.dirty_tiles[i]);
+    }
+
+    void RasterizeTile(u32 tile)
+    {
+        int tile_x = (int)(tile % (u32)tile_count_x);
+        int tile_y = (int)(tile / (u32)tile_count_x);
+
+        ScreenRect rect;
+        rect.min_x = tile_x * DIRTY_TILE_SIZE;
+        rect.min_y = tile_y * DIRTY_TILE_SIZE;
+        rect.max_x = std::min(rect.min_x + DIRTY_TILE_SIZE, width);
+        rect.max_y = std::min(rect.min_y + DIRTY_TILE_SIZE, height);
+
+        rasterizing.clear(rect);
+
+        // NOTE(achal): Entries are binned in submission order, hand every run from the same draw over in one go.
+        const std::vector<BinEntry>& bin = rasterizing.bins[tile];
+        for (size_t begin = 0; begin < bin.size();)
+        {
+            size_t end = begin + 1;
+            while (end < bin.size() && bin[end].draw_index == bin[begin].draw_index)
+                ++end;
+
+            rasterizing.draws[bin[begin].draw_index](rect, bin.data() + begin, (u32)(end - begin));
+            begin = end;
+        }
+
+        if (rasterizing.resolve)
+            rasterizing.resolve(rect);
+    }
+
+    struct TileFrame
+    {
+        std::vector<DeferredDraw> draws;
+        std::vector<std::vector<BinEntry>> bins;
+        std::vector<u32> dirty_tiles;
+        TileFunction clear;
+        TileFunction resolve;
+    };
+
+    int width = 0;
+    int height = 0;
+    int tile_count_x = 0;
+    int tile_count_y = 0;
+
+    std::vector<u64> tile_signatures;
+
+    // NOTE(achal): Signatures of the last frame submitted, into any buffer.
+    std::vector<u64> drawn_signatures;
+
+    std::unordered_map<const void*, std::vector<u64>> buffer_signatures;
+
+    TileFrame binning;
+    TileFrame rasterizing;
+
+    std::atomic<u32> next_dirty_tile{ 0 };
+    std::atomic<u32> finished_job_count{ 0 };
+    u32 job_count = 0;
+};
+
+#define DIRTY_TILE_TRACKER_H
+#endif
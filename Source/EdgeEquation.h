@@ -0,0 +1,299 @@
+#ifndef EDGE_EQUATION_H
+
+#include "Core/Types.h"
+#include "ScreenRect.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <emmintrin.h>
+#include <utility>
+
+// NOTE(achal): Screen space vertex positions get snapped to 16.8 fixed point before setup: 1/256th of a pixel of
+// precision, and everything from there on is integer math. Coverage then no longer depends on how floats happen to
+// round, and a pixel center exactly on an edge shared by two triangles goes to exactly one of them.
+#define SUBPIXEL_BITS 8
+#define SUBPIXEL_ONE (1 << SUBPIXEL_BITS)
+
+// NOTE(achal): 16 bits of integer pixels. Triangles reaching further out than that, there's no clipping to keep
+// them in, don't get drawn.
+#define MAX_SNAPPED_COORDINATE (32767 << SUBPIXEL_BITS)
+
+// NOTE(achal): Triangles with pixel bounds no bigger than this in either direction fit in one stamp and have their
+// coverage evaluated all at once by GetStampCoverage, instead of span by span. Four pixels wide, one SSE register of
+// edge values per row.
+#define SMALL_TRIANGLE_STAMP_SIZE 4
+
+// NOTE(achal): Big triangles get walked in screen aligned RASTER_BLOCK_SIZE x RASTER_BLOCK_SIZE blocks, so the
+// edges only have to be looked at per pixel (per row, really) in the blocks they actually cross.
+#define RASTER_BLOCK_SIZE 8
+
+// NOTE(achal): Multisampling tests coverage and depth at MSAA_SAMPLE_COUNT samples per pixel instead of at the
+// center. They sit where Direct3D's standard 4x pattern puts them, msaa_sample_offsets has them in 1/16ths of a pixel
+// from the center, and no further than MSAA_MAX_SAMPLE_OFFSET subpixels away from it either way.
+#define MSAA_SAMPLE_COUNT 4
+#define MSAA_MAX_SAMPLE_OFFSET (6 * SUBPIXEL_ONE / 16)
+
+static const s32 msaa_sample_offsets[MSAA_SAMPLE_COUNT][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+
+// NOTE(achal): Which pixels count as covered by a triangle. Both conservative rules look at the whole area of the
+// pixel instead of its center, and only make sense single sampled.
+enum CoverageRule
+{
+    // The pixel's center is inside the triangle, or on a top or a left edge of it.
+    COVERAGE_RULE_CENTER,
+
+    // Any of the pixel's area might be inside: every pixel the triangle touches, and then some near its sharpest
+    // corners. Nothing the triangle touches is ever missed, which is what coarse buffers and binning want. The pixel
+    // center can be outside the triangle, attributes get extrapolated to it.
+    COVERAGE_RULE_OVERESTIMATE,
+
+    // All of the pixel's area is inside. Never more coverage than there is, for occluders.
+    COVERAGE_RULE_UNDERESTIMATE
+};
+
+enum EdgeCoverage
+{
+    // None of the pixels are on the inner side of the edge.
+    EDGE_COVERAGE_NONE,
+
+    // Some of the pixels are, the edge crosses them.
+    EDGE_COVERAGE_PARTIAL,
+
+    // All of the pixels are.
+    EDGE_COVERAGE_FULL
+};
+
+// NOTE(achal): E(x, y) = a * x + b * y + c, evaluated at the center of pixel (x, y). The pixel is on the inner side
+// of the edge if E(x, y) >= 0, with the top-left rule of Direct3D already folded into c: a center exactly on the
+// edge only counts if it's a top or a left edge.
+struct EdgeEquation
+{
+    s64 a;
+    s64 b;
+    s64 c;
+};
+
+inline s32 SnapToSubpixel(f32 coordinate)
+{
+    return (s32)std::lrintf(coordinate * (f32)SUBPIXEL_ONE);
+}
+
+inline b32 IsSnappable(f32 coordinate)
+{
+    return std::fabs(coordinate * (f32)SUBPIXEL_ONE) <= (f32)MAX_SNAPPED_COORDINATE;
+}
+
+// Edge from (x0, y0) to (x1, y1), snapped, of a triangle wound so that its inside is to the right of the edge on
+// screen (y pointing down).
+inline EdgeEquation MakeEdgeEquation(s32 x0, s32 y0, s32 x1, s32 y1)
+{
+    s64 dx = (s64)x1 - x0;
+    s64 dy = (s64)y1 - y0;
+
+    // NOTE(achal): E grows towards the inside, which is towards +x for edges going up (dy < 0) and towards +y for
+    // horizontal edges going right. Those are the left and the top edges, the others need E > 0, i.e. E - 1 >= 0.
+    b32 is_top_left = dy < 0 || (dy == 0 && dx > 0);
+
+    // NOTE(achal): E = dx * (py - y0) - dy * (px - x0) with the pixel center (px, py) at
+    // (x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2, y * SUBPIXEL_ONE + SUBPIXEL_ONE / 2).
+    EdgeEquation edge;
+    edge.a = -dy * SUBPIXEL_ONE;
+    edge.b = dx * SUBPIXEL_ONE;
+    edge.c = dx * (SUBPIXEL_ONE / 2 - y0) - dy * (SUBPIXEL_ONE / 2 - x0) - (is_top_left ? 0 : 1);
+    return edge;
+}
+
+// E at the given sample of any pixel minus E at the center of the pixel.
+inline s64 GetSampleEdgeOffset(const EdgeEquation& edge, int sample)
+{
+    // NOTE(achal): a and b are steps of a whole pixel, multiples of SUBPIXEL_ONE, so this is exact.
+    return (edge.a * msaa_sample_offsets[sample][0] + edge.b * msaa_sample_offsets[sample][1]) / 16;
+}
+
+// The edge moved by half a pixel in x and in y, inwards or outwards, so that E >= 0 at the center of a pixel tells
+// whether the pixel is inside all the way (inwards) or at all (outwards) under the original edge.
+inline EdgeEquation GetConservativeEdge(const EdgeEquation& edge, CoverageRule coverage_rule)
+{
+    // NOTE(achal): The corners of the pixel furthest from the edge either way are half a step of a away in x and half
+    // a step of b in y, exact since both are multiples of SUBPIXEL_ONE.
+    s64 corner_offset = (std::abs(edge.a) + std::abs(edge.b)) / 2;
+
+    EdgeEquation result = edge;
+    if (coverage_rule == COVERAGE_RULE_OVERESTIMATE)
+        result.c += corner_offset;
+    else if (coverage_rule == COVERAGE_RULE_UNDERESTIMATE)
+        result.c -= corner_offset;
+    return result;
+}
+
+inline s64 FloorDiv(s64 numerator, s64 denominator)
+{
+    s64 quotient = numerator / denominator;
+    return (numerator % denominator != 0 && ((numerator < 0) != (denominator < 0))) ? quotient - 1 : quotient;
+}
+
+inline s64 CeilDiv(s64 numerator, s64 denominator)
+{
+    return -FloorDiv(-numerator, denominator);
+}
+
+// Narrows the span [*start, *end) of the row whose edge value at x = 0 is row_value (E(0, y)) to the pixels on
+// the inner side of the edge.
+inline void ClipSpanToEdge(const EdgeEquation& edge, s64 row_value, int* start, int* end)
+{
+    if (edge.a > 0)
+    {
+        s64 first = CeilDiv(-row_value, edge.a);
+        if (first > *start)
+            *start = first < *end ? (int)first : *end;
+    }
+    else if (edge.a < 0)
+    {
+        s64 last = FloorDiv(row_value, -edge.a);
+        if (last + 1 < *end)
+            *end = last + 1 > *start ? (int)(last + 1) : *start;
+    }
+    else if (row_value < 0)
+    {
+        *end = *start;
+    }
+}
+
+inline b32 FitsInStamp(const ScreenRect& bounds)
+{
+    return bounds.max_x - bounds.min_x <= SMALL_TRIANGLE_STAMP_SIZE &&
+        bounds.max_y - bounds.min_y <= SMALL_TRIANGLE_STAMP_SIZE;
+}
+
+// Coverage of the width x height pixels (at most SMALL_TRIANGLE_STAMP_SIZE each) starting at (x, y), all of them
+// within the bounds of a triangle that FitsInStamp. Writes one mask per row, bit i set if pixel x + i is on the inner
+// side of all three edges.
+inline void GetStampCoverage(const EdgeEquation* edges, int x, int y, int width, int height, u32* row_masks)
+{
+    // NOTE(achal): The vertices of a triangle that fits are less than SMALL_TRIANGLE_STAMP_SIZE + 1 pixels apart,
+    // in 16.8 that keeps a and b under 2^19 and every edge value anywhere near the triangle under 2^23, so 32 bits
+    // are plenty. Only the value at the stamp's origin needs the full equation.
+    __m128i values[3];
+    __m128i steps_y[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        s32 origin = (s32)(edges[i].a * x + edges[i].b * y + edges[i].c);
+        s32 a = (s32)edges[i].a;
+        values[i] = _mm_add_epi32(_mm_set1_epi32(origin), _mm_setr_epi32(0, a, 2 * a, 3 * a));
+        steps_y[i] = _mm_set1_epi32((s32)edges[i].b);
+    }
+
+    u32 column_mask = (1u << width) - 1;
+    for (int row = 0; row < height; ++row)
+    {
+        // NOTE(achal): A pixel is outside if any of its edge values is negative, so the sign bits of the three
+        // OR'ed together are the pixels that aren't covered.
+        __m128i outside = _mm_or_si128(_mm_or_si128(values[0], values[1]), values[2]);
+        row_masks[row] = ~(u32)_mm_movemask_ps(_mm_castsi128_ps(outside)) & column_mask;
+
+        for (int i = 0; i < 3; ++i)
+            values[i] = _mm_add_epi32(values[i], steps_y[i]);
+    }
+}
+
+// Which of the pixels of rect are on the inner side of the edge.
+inline EdgeCoverage GetRectEdgeCoverage(const EdgeEquation& edge, const ScreenRect& rect)
+{
+    // NOTE(achal): E is linear, so over the pixels of the rect it's smallest at one corner pixel and largest at the
+    // opposite one, which ones depends on the signs of a and b.
+    s64 first_x = rect.min_x;
+    s64 first_y = rect.min_y;
+    s64 last_x = rect.max_x - 1;
+    s64 last_y = rect.max_y - 1;
+    s64 min_value = edge.a * (edge.a < 0 ? last_x : first_x) + edge.b * (edge.b < 0 ? last_y : first_y) + edge.c;
+    s64 max_value = edge.a * (edge.a < 0 ? first_x : last_x) + edge.b * (edge.b < 0 ? first_y : last_y) + edge.c;
+
+    if (max_value < 0)
+        return EDGE_COVERAGE_NONE;
+    if (min_value >= 0)
+        return EDGE_COVERAGE_FULL;
+    return EDGE_COVERAGE_PARTIAL;
+}
+
+// Pixels whose centers are inside the snapped bounding box, [min_x, max_x) x [min_y, max_y).
+inline ScreenRect GetPixelBounds(s32 min_x, s32 min_y, s32 max_x, s32 max_y)
+{
+    // NOTE(achal): Pixel x has its center inside if min_x <= x * SUBPIXEL_ONE + SUBPIXEL_ONE / 2 <= max_x.
+    // Arithmetic shifts floor, even for negative numbers.
+    ScreenRect bounds;
+    bounds.min_x = (min_x - SUBPIXEL_ONE / 2 + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    bounds.min_y = (min_y - SUBPIXEL_ONE / 2 + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+    bounds.max_x = ((max_x - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS) + 1;
+    bounds.max_y = ((max_y - SUBPIXEL_ONE / 2) >> SUBPIXEL_BITS) + 1;
+    return bounds;
+}
+
+// Pixels with any of their area inside the snapped bounding box, [min_x, max_x) x [min_y, max_y).
+inline ScreenRect GetTouchedPixelBounds(s32 min_x, s32 min_y, s32 max_x, s32 max_y)
+{
+    // NOTE(achal): Pixel x covers [x * SUBPIXEL_ONE, (x + 1) * SUBPIXEL_ONE), a box ending right on the left side of
+    // a pixel still touches it, conservatively.
+    ScreenRect bounds;
+    bounds.min_x = min_x >> SUBPIXEL_BITS;
+    bounds.min_y = min_y >> SUBPIXEL_BITS;
+    bounds.max_x = (max_x >> SUBPIXEL_BITS) + 1;
+    bounds.max_y = (max_y >> SUBPIXEL_BITS) + 1;
+    return bounds;
+}
+
+// Snaps the screen space triangle with vertices (x[i], y[i]) and sets up its edges and the pixels it can cover,
+// with sample_count samples per pixel and coverage_rule. Returns false if the triangle can't be drawn or doesn't
+// cover any pixels.
+inline b32 SetupEdges(const f32* x, const f32* y, int sample_count, CoverageRule coverage_rule, EdgeEquation* edges,
+    ScreenRect* bounds)
+{
+    assert(coverage_rule == COVERAGE_RULE_CENTER || sample_count == 1);
+
+    s32 snapped_x[3], snapped_y[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        if (!IsSnappable(x[i]) || !IsSnappable(y[i]))
+            return false;
+
+        snapped_x[i] = SnapToSubpixel(x[i]);
+        snapped_y[i] = SnapToSubpixel(y[i]);
+    }
+
+    // NOTE(achal): The edge equations want the inside to the right of every edge, wind the triangle that way.
+    s64 area = ((s64)snapped_x[1] - snapped_x[0]) * ((s64)snapped_y[2] - snapped_y[0]) -
+        ((s64)snapped_y[1] - snapped_y[0]) * ((s64)snapped_x[2] - snapped_x[0]);
+    if (area == 0)
+        return false;
+
+    if (area < 0)
+    {
+        std::swap(snapped_x[1], snapped_x[2]);
+        std::swap(snapped_y[1], snapped_y[2]);
+    }
+
+    edges[0] = MakeEdgeEquation(snapped_x[0], snapped_y[0], snapped_x[1], snapped_y[1]);
+    edges[1] = MakeEdgeEquation(snapped_x[1], snapped_y[1], snapped_x[2], snapped_y[2]);
+    edges[2] = MakeEdgeEquation(snapped_x[2], snapped_y[2], snapped_x[0], snapped_y[0]);
+    if (coverage_rule != COVERAGE_RULE_CENTER)
+    {
+        for (int i = 0; i < 3; ++i)
+            edges[i] = GetConservativeEdge(edges[i], coverage_rule);
+    }
+
+    // NOTE(achal): With multisampling a pixel is in as soon as any of its samples could be.
+    s32 sample_margin = sample_count > 1 ? MSAA_MAX_SAMPLE_OFFSET : 0;
+    s32 min_x = std::min(snapped_x[0], std::min(snapped_x[1], snapped_x[2])) - sample_margin;
+    s32 min_y = std::min(snapped_y[0], std::min(snapped_y[1], snapped_y[2])) - sample_margin;
+    s32 max_x = std::max(snapped_x[0], std::max(snapped_x[1], snapped_x[2])) + sample_margin;
+    s32 max_y = std::max(snapped_y[0], std::max(snapped_y[1], snapped_y[2])) + sample_margin;
+    if (coverage_rule == COVERAGE_RULE_OVERESTIMATE)
+        *bounds = GetTouchedPixelBounds(min_x, min_y, max_x, max_y);
+    else
+        *bounds = GetPixelBounds(min_x, min_y, max_x, max_y);
+    return bounds->min_x < bounds->max_x && bounds->min_y < bounds->max_y;
+}
+
+#define EDGE_EQUATION_H
+#endif
@@ -5,10 +5,15 @@
 #include "FaceColorCubeScene.h"
 #include "CubeVertexPositionColorScene.h"
 #include "WavyPlaneScene.h"
+#include "OccluderScene.h"
+#include "TextureManager.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image/stb_image.h>
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <limits>
 #include <utility>
 
 /*
@@ -20,6 +25,11 @@
 
 void Engine::Initialize(int width, int height, int channel_count, void* pixels)
 {
+    job_pool.Initialize();
+
+    // NOTE(achal): Textures are decoded on the pool, scenes draw with a placeholder until theirs are in.
+    TextureManager::Get().SetJobPool(&job_pool);
+
     scene = std::make_unique<WavyPlaneScene>();
 
     framebuffer.width = width;
@@ -32,6 +42,60 @@ void Engine::Initialize(int width, int height, int channel_count, void* pixels)
     z_buffer.height = height;
     z_buffer.z_values = (f32*)malloc((size_t)width * (size_t)height * sizeof(f32));
     scene->SetZBuffer(&z_buffer);
+
+    tile_tracker.Initialize(width, height);
+    scene->SetTileTracker(&tile_tracker);
+    scene->SetRenderQueue(&render_queue);
+
+    occlusion_buffer.Initialize(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT);
+    scene->SetOcclusionBuffer(&occlusion_buffer);
+}
+
+Engine::~Engine()
+{
+    Flush();
+    TextureManager::Get().SetJobPool(NULL);
+
+    free(multisample_framebuffer.pixels);
+    free(z_buffer.z_values);
+}
+
+// NOTE(achal): Render into the swap chain's back buffers instead of a single caller owned buffer. Every call to
+// Render acquires a back buffer, draws into it and queues it for presentation.
+void Engine::Initialize(SwapChain* swap_chain)
+{
+    this->swap_chain = swap_chain;
+    Initialize(swap_chain->width, swap_chain->height, swap_chain->channel_count, NULL);
+}
+
+// NOTE(achal): 1 draws straight into framebuffer, MSAA_SAMPLE_COUNT has the scene draw into multisample_framebuffer
+// instead, with coverage and depth per sample, and every tile gets resolved into framebuffer once it's done.
+void Engine::SetSampleCount(int sample_count)
+{
+    assert(sample_count == 1 || sample_count == MSAA_SAMPLE_COUNT);
+    Flush();
+
+    size_t sample_total = (size_t)framebuffer.width * (size_t)framebuffer.height * (size_t)sample_count;
+    free(z_buffer.z_values);
+    z_buffer.z_values = (f32*)malloc(sample_total * sizeof(f32));
+    z_buffer.sample_count = (u32)sample_count;
+
+    free(multisample_framebuffer.pixels);
+    multisample_framebuffer = framebuffer;
+    multisample_framebuffer.pixels = NULL;
+    if (sample_count > 1)
+    {
+        multisample_framebuffer.pixels = malloc(sample_total * sizeof(u32));
+        multisample_framebuffer.sample_count = sample_count;
+        scene->SetFramebuffer(&multisample_framebuffer);
+    }
+    else
+    {
+        scene->SetFramebuffer(&framebuffer);
+    }
+
+    // NOTE(achal): Whatever the buffers hold was drawn with the old sample count.
+    tile_tracker.Invalidate();
 }
 
 // Wraps the given angle in the range -PI to PI
@@ -71,10 +135,76 @@ void Engine::UpdateModel()
     scene->SetTime(time);
 }
 
-void Engine::Render()
+// NOTE(achal): The scene draws its occluders and runs its geometry, skipping whatever they hide, the render queue
+// sorts its draws front to back and they bin their triangles into screen tiles in that order. Only the tiles whose
+// triangles changed get cleared and rasterized again, on the job pool, see DirtyTileTracker. A frame identical to the
+// one on screen is skipped entirely, nothing gets acquired or presented, and Render returns false so the caller can
+// wait for input instead of asking again.
+//
+// With a swap chain, Render returns as soon as the tiles of the frame are submitted. The geometry of the next frame
+// then runs while the pool is still busy rasterizing this one, which only gets presented once the next Render (or
+// Flush) has waited for its tiles.
+b32 Engine::Render()
 {
-    framebuffer.Clear();
-    z_buffer.Clear();
     UpdateModel();
+
+    tile_tracker.BeginFrame(clear_color);
+
+    // NOTE(achal): Drawn right away, every draw after this gets tested against them.
+    occlusion_buffer.Clear();
+    scene->DrawOccluders();
+
+    if (depth_pre_pass)
+    {
+        scene->SetDepthTest(DEPTH_TEST_EQUAL);
+        scene->DrawDepth();
+    }
+    else
+    {
+        scene->SetDepthTest(DEPTH_TEST_LESS);
+    }
     scene->Draw();
-}
\ No newline at end of file
+    render_queue.Flush();
+    scene->EndFrame();
+
+    Flush();
+
+    if (tile_tracker.IsFrameUnchanged())
+        return false;
+
+    if (swap_chain)
+        framebuffer.pixels = swap_chain->AcquireBackBuffer();
+
+    b32 is_multisampled = z_buffer.sample_count > 1;
+    Framebuffer* draw_framebuffer = is_multisampled ? &multisample_framebuffer : &framebuffer;
+
+    DirtyTileTracker::TileFunction resolve;
+    if (is_multisampled)
+        resolve = [this](const ScreenRect& rect) { multisample_framebuffer.ResolveRect(rect, &framebuffer); };
+
+    tile_tracker.SubmitDirtyTiles(&job_pool, framebuffer.pixels, [this, draw_framebuffer](const ScreenRect& rect)
+    {
+        draw_framebuffer->ClearRect(rect, clear_color);
+        z_buffer.ClearRect(rect, std::numeric_limits<f32>::infinity());
+    }, resolve);
+    frame_in_flight = true;
+
+    // NOTE(achal): Without a swap chain the caller owns the one buffer there is and expects the frame in it.
+    if (!swap_chain)
+        Flush();
+
+    return true;
+}
+
+// Waits for the tiles of the frame in flight, if there is one, and presents it.
+void Engine::Flush()
+{
+    if (!frame_in_flight)
+        return;
+
+    tile_tracker.WaitForTiles(&job_pool);
+    frame_in_flight = false;
+
+    if (swap_chain)
+        swap_chain->Present();
+}
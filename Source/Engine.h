@@ -1,9 +1,15 @@
 #ifndef ENGINE_H
 
 #include "Core/Types.h"
+#include "Core/JobPool.h"
+#include "DirtyTileTracker.h"
+#include "EdgeEquation.h"
 #include "Framebuffer.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
 #include "ZBuffer.h"
 #include "Scene.h"
+#include "SwapChain.h"
 
 #include <cmath>
 #include <memory>
@@ -19,16 +25,39 @@ struct Button
 
 struct Engine
 {
+    ~Engine();
+
     void Initialize(int width, int height, int channel_count, void* pixels);
+    void Initialize(SwapChain* swap_chain);
+    void SetSampleCount(int sample_count);
     void UpdateModel();
-    void Render();
+    b32 Render();
+    void Flush();
 
     Button buttons[3];
     
+    JobPool job_pool;
+    SwapChain* swap_chain = NULL;
     Framebuffer framebuffer;
+
+    // NOTE(achal): What the scene draws into instead of framebuffer when multisampling, see SetSampleCount.
+    Framebuffer multisample_framebuffer = {};
+
     ZBuffer z_buffer;
+    DirtyTileTracker tile_tracker;
+    RenderQueue render_queue;
+    OcclusionBuffer occlusion_buffer;
+    u32 clear_color = 0x202020;
     std::unique_ptr<Scene> scene = NULL;
     f32 time = 0.f;
+
+    // NOTE(achal): Lays down the depth of the whole scene with its depth-only path first and then draws it in full
+    // with DEPTH_TEST_EQUAL, so every visible pixel gets shaded exactly once, however much overdraw there is. Worth it
+    // when pixel shading costs a lot more than another round of depth.
+    b32 depth_pre_pass = false;
+
+    // NOTE(achal): Whether the tiles of the last frame might still be getting rasterized, see Render.
+    b32 frame_in_flight = false;
 };
 
 #define ENGINE_H
@@ -3,11 +3,13 @@
 #include "Scene.h"
 #include "IndexedTriangleList.h"
 #include "Pipeline.h"
+#include "DepthPipeline.h"
 #include "FaceColorEffect.h"
 
 struct FaceColorCubeScene : public Scene
 {
     typedef Pipeline<FaceColorEffect> Pipeline;
+    typedef DepthPipeline<FaceColorEffect> DepthPipeline;
     typedef Pipeline::Vertex Vertex;
 
     inline u32 PackColor(const glm::vec3& color)
@@ -141,6 +143,18 @@ struct FaceColorCubeScene : public Scene
         pipeline.Draw(it_list);
     }
 
+    void DrawDepth() override
+    {
+        depth_pipeline.vertex_shader = pipeline.effect.vertex_shader;
+        depth_pipeline.Draw(it_list);
+    }
+
+    void EndFrame() override
+    {
+        pipeline.EndFrame();
+        depth_pipeline.EndFrame();
+    }
+
     void SetFramebuffer(Framebuffer* framebuffer) override
     {
         pipeline.framebuffer = framebuffer;
@@ -149,6 +163,42 @@ struct FaceColorCubeScene : public Scene
     void SetZBuffer(ZBuffer* z_buffer) override
     {
         pipeline.z_buffer = z_buffer;
+        depth_pipeline.z_buffer = z_buffer;
+    }
+
+    void SetTileTracker(DirtyTileTracker* tile_tracker) override
+    {
+        pipeline.tile_tracker = tile_tracker;
+        depth_pipeline.tile_tracker = tile_tracker;
+    }
+
+    void SetRenderQueue(RenderQueue* render_queue) override
+    {
+        pipeline.render_queue = render_queue;
+        depth_pipeline.render_queue = render_queue;
+    }
+
+    void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) override
+    {
+        pipeline.occlusion_buffer = occlusion_buffer;
+        depth_pipeline.occlusion_buffer = occlusion_buffer;
+    }
+
+    void SetDepthTest(DepthTest depth_test) override
+    {
+        pipeline.depth_test = depth_test;
+    }
+
+    void SetViewport(const ScreenRect& viewport) override
+    {
+        pipeline.viewport = viewport;
+        depth_pipeline.viewport = viewport;
+    }
+
+    void SetScissor(const ScreenRect& scissor) override
+    {
+        pipeline.scissor = scissor;
+        depth_pipeline.scissor = scissor;
     }
 
     void SetModel(const glm::mat4& model) override
@@ -158,6 +208,7 @@ struct FaceColorCubeScene : public Scene
 
     IndexedTriangleList<Vertex> it_list;
     Pipeline pipeline;
+    DepthPipeline depth_pipeline;
 };
 
 #define FACE_COLOR_CUBE_SCENE_H
@@ -1,9 +1,12 @@
 #ifndef FRAMEBUFFER_H
 
 #include "Core/Types.h"
+#include "ScreenRect.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <emmintrin.h>
 
 struct Framebuffer
 {
@@ -15,15 +18,95 @@ struct Framebuffer
         *pixel = color;
     }
 
-    inline void Clear()
+    // NOTE(achal): The span functions below do no bounds checking of their own, every span the rasterizer hands them
+    // is clipped to the framebuffer (see Pipeline::DrawTriangle), debug builds assert the row and the start of it.
+    // Addressing is done once per row with GetRow. A multisampled row holds the samples of its pixels one pixel after
+    // the other, pixel x's at row[x * sample_count], so the span functions work on samples just the same.
+    inline u32* GetRow(int y)
     {
-        memset(pixels, 32, (size_t)width * (size_t)height * (size_t)channel_count);
+        assert(y >= 0 && y < height);
+        return (u32*)pixels + ((size_t)y * (size_t)width * (size_t)sample_count);
+    }
+
+    // Stores colors[i] at row[x + i] for every i in [0, count) whose bit is set in mask.
+    inline static void StoreSpanMasked(u32* row, int x, int count, const u32* colors, u32 mask)
+    {
+        assert(x >= 0 && count >= 0);
+        u32* pixel = row + x;
+        for (int i = 0; i < count; ++i)
+            pixel[i] = ((mask >> i) & 1) ? colors[i] : pixel[i];
+    }
+
+    inline void Clear(u32 color)
+    {
+        ScreenRect rect = { 0, 0, width, height };
+        ClearRect(rect, color);
+    }
+
+    // NOTE(achal): Goes through the cache. A rect gets cleared right before the rasterizer reads and writes it again,
+    // streaming it out to memory would only make it miss.
+    inline void ClearRect(const ScreenRect& rect, u32 color)
+    {
+        assert(rect.min_x >= 0 && rect.max_x <= width && rect.min_y >= 0 && rect.max_y <= height);
+        for (int y = rect.min_y; y < rect.max_y; ++y)
+        {
+            u32* row = GetRow(y);
+            std::fill(row + rect.min_x * sample_count, row + rect.max_x * sample_count, color);
+        }
+    }
+
+    // Averages the MSAA_SAMPLE_COUNT samples of every pixel of rect into the same pixel of target, which has a
+    // single sample per pixel and the same size.
+    inline void ResolveRect(const ScreenRect& rect, Framebuffer* target)
+    {
+        assert(sample_count == 4 && target->sample_count == 1);
+        assert(target->width == width && target->height == height);
+        assert(rect.min_x >= 0 && rect.max_x <= width && rect.min_y >= 0 && rect.max_y <= height);
+
+        __m128i rounding = _mm_set1_epi16(2);
+        for (int y = rect.min_y; y < rect.max_y; ++y)
+        {
+            const __m128i* samples = (const __m128i*)(GetRow(y) + rect.min_x * 4);
+            u32* pixel = target->GetRow(y) + rect.min_x;
+            int count = rect.max_x - rect.min_x;
+
+            // NOTE(achal): One register holds the four samples of a pixel. Four pixels at a time, their channel
+            // sums get averaged and packed back to 8 bits together.
+            int i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i sums01 = _mm_unpacklo_epi64(SumSamples(_mm_loadu_si128(samples + i)),
+                    SumSamples(_mm_loadu_si128(samples + i + 1)));
+                __m128i sums23 = _mm_unpacklo_epi64(SumSamples(_mm_loadu_si128(samples + i + 2)),
+                    SumSamples(_mm_loadu_si128(samples + i + 3)));
+                __m128i average01 = _mm_srli_epi16(_mm_add_epi16(sums01, rounding), 2);
+                __m128i average23 = _mm_srli_epi16(_mm_add_epi16(sums23, rounding), 2);
+                _mm_storeu_si128((__m128i*)(pixel + i), _mm_packus_epi16(average01, average23));
+            }
+
+            for (; i < count; ++i)
+            {
+                __m128i average = _mm_srli_epi16(_mm_add_epi16(SumSamples(_mm_loadu_si128(samples + i)), rounding), 2);
+                pixel[i] = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(average, average));
+            }
+        }
+    }
+
+    // Sums the channels of the four samples in samples, the sums end up as the 16-bit lanes of the low half.
+    inline static __m128i SumSamples(__m128i samples)
+    {
+        __m128i zero = _mm_setzero_si128();
+        __m128i sums = _mm_add_epi16(_mm_unpacklo_epi8(samples, zero), _mm_unpackhi_epi8(samples, zero));
+        return _mm_add_epi16(sums, _mm_srli_si128(sums, 8));
     }
 
     int width;
     int height;
     int channel_count;
     void* pixels;
+
+    // NOTE(achal): 1, or MSAA_SAMPLE_COUNT for a buffer that gets drawn multisampled and then resolved.
+    int sample_count = 1;
 };
 
 #define FRAMEBUFFER_H
@@ -1,12 +1,67 @@
 #ifndef INDEXED_TRIANGLE_LIST
 
+#include "Core/Types.h"
+
+#include <atomic>
+#include <utility>
 #include <vector>
 
+// NOTE(achal): Never the same twice in a run, unlike the address of a list, which the next list allocated after it
+// is destroyed may well get.
+inline u64 NewIndexedTriangleListId()
+{
+    static std::atomic<u64> next_id(1);
+    return next_id.fetch_add(1, std::memory_order_relaxed);
+}
+
 template <typename Vertex>
 struct IndexedTriangleList
 {
+    IndexedTriangleList() : id(NewIndexedTriangleListId())
+    {
+    }
+
+    // NOTE(achal): A copy is a mesh of its own, which may change independently of the original, and so is a list
+    // that got moved from or assigned to. None of them keep an id.
+    IndexedTriangleList(const IndexedTriangleList& other) : vertices(other.vertices), indices(other.indices),
+        version(other.version), id(NewIndexedTriangleListId())
+    {
+    }
+
+    IndexedTriangleList(IndexedTriangleList&& other) : vertices(std::move(other.vertices)),
+        indices(std::move(other.indices)), version(other.version), id(NewIndexedTriangleListId())
+    {
+        other.id = NewIndexedTriangleListId();
+    }
+
+    IndexedTriangleList& operator = (const IndexedTriangleList& other)
+    {
+        vertices = other.vertices;
+        indices = other.indices;
+        version = other.version;
+        id = NewIndexedTriangleListId();
+        return *this;
+    }
+
+    IndexedTriangleList& operator = (IndexedTriangleList&& other)
+    {
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        version = other.version;
+        id = NewIndexedTriangleListId();
+        other.id = NewIndexedTriangleListId();
+        return *this;
+    }
+
     std::vector<Vertex> vertices;
     std::vector<size_t> indices;
+
+    // NOTE(achal): Pipelines hold on to what they computed from the list last time they drew it, bump this after
+    // changing the vertices or the indices.
+    u64 version = 0;
+
+    // NOTE(achal): What pipelines key what they hold on to by, see NewIndexedTriangleListId.
+    u64 id;
 };
 
 #define INDEXED_TRIANGLE_LIST
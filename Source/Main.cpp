@@ -1,4 +1,5 @@
 #include "Engine.h"
+#include "TextureManager.h"
 
 // TODO(achal): Disable all the bullshit that we don't need -- NOMINMAX etc.
 #include <Windows.h>
@@ -8,15 +9,14 @@ struct Win32Framebuffer
     int width;
     int height;
     int channel_count;
-    void* pixels;
     BITMAPINFO info;
 };
 
-void Win32DisplayImage(const Win32Framebuffer& win32_framebuffer, HDC device_context)
+void Win32DisplayImage(const Win32Framebuffer& win32_framebuffer, const void* pixels, HDC device_context)
 {
     // TODO(achal): Aspect ratio correction.
     StretchDIBits(device_context, 0, 0, win32_framebuffer.width, win32_framebuffer.height, 0, 0, win32_framebuffer.width,
-        win32_framebuffer.height, win32_framebuffer.pixels, &win32_framebuffer.info, DIB_RGB_COLORS, SRCCOPY);
+        win32_framebuffer.height, pixels, &win32_framebuffer.info, DIB_RGB_COLORS, SRCCOPY);
 }
 
 static b32 global_rotate_x_key_pressed;
@@ -86,7 +86,9 @@ LRESULT CALLBACK Win32WindowCallback(HWND window, UINT message, WPARAM w_param,
 HWND Win32CreateWindow(int width, int height, LPCWSTR name, HINSTANCE instance)
 {
     WNDCLASS WindowClass = {};
-    WindowClass.style = CS_CLASSDC;
+    // NOTE(achal): CS_OWNDC so that the device context we get once at startup stays valid for the lifetime of
+    // the window and can be handed to the present thread.
+    WindowClass.style = CS_OWNDC;
     WindowClass.lpfnWndProc = Win32WindowCallback;
     WindowClass.hInstance = instance;
     WindowClass.lpszClassName = L"SoftwareRenderingEngineWindowClass";
@@ -142,35 +144,55 @@ int CALLBACK WinMain(HINSTANCE instance, HINSTANCE prev_instance, PSTR command_l
     win32_framebuffer.info.bmiHeader.biBitCount = (WORD)(win32_framebuffer.channel_count * 8);
     win32_framebuffer.info.bmiHeader.biCompression = BI_RGB;
 
-    // NOTE(achal): This allocated memory is not explicitly freed anywhere in the program because
-    // it'll get freed automatically when the program exits. This could, however, become a problem
-    // of memory leak, when we allocate this repeatedly, for example, in a loop.
-    win32_framebuffer.pixels = VirtualAlloc(0, (size_t)win32_framebuffer.width * (size_t)win32_framebuffer.height
-        * (size_t)win32_framebuffer.channel_count, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    HDC device_context = GetDC(window);
 
-    if (!win32_framebuffer.pixels)
+    // NOTE(achal): Frames are blitted to the window on the swap chain's present thread, while the engine
+    // is already rendering the next one.
+    SwapChain swap_chain;
+    b32 swap_chain_initialized = swap_chain.Initialize(win32_framebuffer.width, win32_framebuffer.height,
+        win32_framebuffer.channel_count, 2, [&win32_framebuffer, device_context](const void* pixels)
+        {
+            Win32DisplayImage(win32_framebuffer, pixels, device_context);
+        });
+
+    if (!swap_chain_initialized)
     {
-        OutputDebugString(L"Unable to allocate memory for image buffer\n");
+        OutputDebugString(L"Unable to allocate memory for the swap chain buffers\n");
         exit(1);
     }
 
+    // NOTE(achal): A texture swapped in for its placeholder changes the frame without any input, wake the loop up
+    // from WaitMessage to draw it. Set before the engine creates the scene, which starts loading its textures.
+    DWORD main_thread_id = GetCurrentThreadId();
+    TextureManager::Get().SetLoadCallback([main_thread_id]()
+    {
+        PostThreadMessage(main_thread_id, WM_NULL, 0, 0);
+    });
+
     Engine engine;
-    engine.Initialize(win32_framebuffer.width, win32_framebuffer.height, win32_framebuffer.channel_count, win32_framebuffer.pixels);
+    engine.Initialize(&swap_chain);
+    engine.SetSampleCount(MSAA_SAMPLE_COUNT);
 
     while (true)
     {
         b32 should_quit = Win32PollEvents();
         if (should_quit)
-            return 0;
+            break;
 
         engine.buttons[0].pressed = global_rotate_x_key_pressed;
         engine.buttons[1].pressed = global_rotate_y_key_pressed;
         engine.buttons[2].pressed = global_rotate_z_key_pressed;
 
-        engine.Render();
-
-        Win32DisplayImage(win32_framebuffer, GetDC(window));
+        // NOTE(achal): Nothing moved and the frame on screen is still current, no point rendering it again until
+        // some input arrives, or a texture finishes loading. Animated scenes change every frame and never wait here.
+        b32 frame_changed = engine.Render();
+        if (!frame_changed)
+            WaitMessage();
     }
 
+    engine.Flush();
+    swap_chain.Shutdown();
+    ReleaseDC(window, device_context);
+
     return 0;
 }
@@ -0,0 +1,186 @@
+#ifndef OCCLUDER_SCENE_H
+
+#include "Core/Types.h"
+#include "Scene.h"
+#include "IndexedTriangleList.h"
+#include "OcclusionBuffer.h"
+#include "Pipeline.h"
+#include "DepthPipeline.h"
+#include "VertexColorEffect.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+
+#define OCCLUDER_SCENE_CUBE_COLUMNS 5
+#define OCCLUDER_SCENE_CUBE_ROWS 3
+
+// NOTE(achal): A wall that stays put right in front of the camera, and a grid of small cubes behind it turning with
+// the model matrix. The wall is the occluder: the cubes in the middle of the grid are behind it until the grid turns
+// them out from behind, and never go through the vertex shader until then.
+struct OccluderScene : public Scene
+{
+    typedef Pipeline<VertexColorEffect> Pipeline;
+    typedef DepthPipeline<VertexColorEffect> DepthPipeline;
+    typedef Pipeline::Vertex Vertex;
+
+    OccluderScene()
+    {
+        wall = MakeBox(glm::vec3(0.55f, 0.55f, 0.05f), glm::vec3(0.6f, 0.6f, 0.65f));
+        wall_model = glm::translate(glm::mat4(1.f), glm::vec3(0.f, 0.f, -1.2f));
+
+        // NOTE(achal): Every cube is a list of its own, pipelines hold on to what they computed for each of them.
+        IndexedTriangleList<Vertex> cube = MakeBox(glm::vec3(0.12f), glm::vec3(1.f));
+        for (int row = 0; row < OCCLUDER_SCENE_CUBE_ROWS; ++row)
+        {
+            for (int column = 0; column < OCCLUDER_SCENE_CUBE_COLUMNS; ++column)
+            {
+                cubes.push_back(cube);
+                cube_offsets.push_back(glm::vec3(-1.2f + 0.6f * column, -0.6f + 0.6f * row, 0.f));
+            }
+        }
+        cube_models.resize(cubes.size(), glm::mat4(1.f));
+    }
+
+    // NOTE(achal): Colors fade from half of color at the min corner to all of it at the max corner.
+    static IndexedTriangleList<Vertex> MakeBox(const glm::vec3& half_extents, const glm::vec3& color)
+    {
+        // NOTE(achal): Same corners and winding as ColorCubeScene.
+        static const glm::vec3 corners[8] =
+        {
+            { -1.f, -1.f, -1.f }, { 1.f, -1.f, -1.f }, { 1.f, -1.f, 1.f }, { -1.f, -1.f, 1.f },
+            { -1.f, 1.f, 1.f }, { -1.f, 1.f, -1.f }, { 1.f, 1.f, -1.f }, { 1.f, 1.f, 1.f }
+        };
+
+        static const size_t indices[36] =
+        {
+            3, 5, 0, 3, 4, 5,
+            2, 4, 3, 2, 7, 4,
+            1, 7, 2, 1, 6, 7,
+            1, 5, 6, 1, 0, 5,
+            7, 5, 4, 7, 6, 5,
+            3, 0, 2, 0, 1, 2
+        };
+
+        IndexedTriangleList<Vertex> box;
+        box.vertices.resize(8);
+        for (int i = 0; i < 8; ++i)
+        {
+            box.vertices[i].position = corners[i] * half_extents;
+            box.vertices[i].color = color * (0.75f + 0.25f * corners[i]);
+        }
+        box.indices.assign(indices, indices + 36);
+        return box;
+    }
+
+    void Draw() override
+    {
+        pipeline.effect.vertex_shader.model = wall_model;
+        pipeline.Draw(wall);
+
+        for (size_t i = 0; i < cubes.size(); ++i)
+        {
+            pipeline.effect.vertex_shader.model = cube_models[i];
+            pipeline.Draw(cubes[i]);
+        }
+    }
+
+    void DrawDepth() override
+    {
+        depth_pipeline.vertex_shader.model = wall_model;
+        depth_pipeline.Draw(wall);
+
+        for (size_t i = 0; i < cubes.size(); ++i)
+        {
+            depth_pipeline.vertex_shader.model = cube_models[i];
+            depth_pipeline.Draw(cubes[i]);
+        }
+    }
+
+    void DrawOccluders() override
+    {
+        if (!occlusion_buffer)
+            return;
+
+        occluder_pipeline.vertex_shader.model = wall_model;
+        DrawOccluder(&occluder_pipeline, occlusion_buffer, wall);
+    }
+
+    void EndFrame() override
+    {
+        pipeline.EndFrame();
+        depth_pipeline.EndFrame();
+        occluder_pipeline.EndFrame();
+    }
+
+    void SetFramebuffer(Framebuffer* framebuffer) override
+    {
+        pipeline.framebuffer = framebuffer;
+    }
+
+    void SetZBuffer(ZBuffer* z_buffer) override
+    {
+        pipeline.z_buffer = z_buffer;
+        depth_pipeline.z_buffer = z_buffer;
+    }
+
+    void SetTileTracker(DirtyTileTracker* tile_tracker) override
+    {
+        pipeline.tile_tracker = tile_tracker;
+        depth_pipeline.tile_tracker = tile_tracker;
+    }
+
+    void SetRenderQueue(RenderQueue* render_queue) override
+    {
+        pipeline.render_queue = render_queue;
+        depth_pipeline.render_queue = render_queue;
+    }
+
+    void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) override
+    {
+        this->occlusion_buffer = occlusion_buffer;
+        pipeline.occlusion_buffer = occlusion_buffer;
+        depth_pipeline.occlusion_buffer = occlusion_buffer;
+    }
+
+    void SetDepthTest(DepthTest depth_test) override
+    {
+        pipeline.depth_test = depth_test;
+    }
+
+    void SetViewport(const ScreenRect& viewport) override
+    {
+        pipeline.viewport = viewport;
+        depth_pipeline.viewport = viewport;
+    }
+
+    void SetScissor(const ScreenRect& scissor) override
+    {
+        pipeline.scissor = scissor;
+        depth_pipeline.scissor = scissor;
+    }
+
+    // NOTE(achal): Turns the grid of cubes, the wall stays where it is.
+    void SetModel(const glm::mat4& model) override
+    {
+        for (size_t i = 0; i < cubes.size(); ++i)
+            cube_models[i] = glm::translate(model, cube_offsets[i]);
+    }
+
+    IndexedTriangleList<Vertex> wall;
+    glm::mat4 wall_model;
+
+    std::vector<IndexedTriangleList<Vertex>> cubes;
+    std::vector<glm::vec3> cube_offsets;
+    std::vector<glm::mat4> cube_models;
+
+    Pipeline pipeline;
+    DepthPipeline depth_pipeline;
+
+    // NOTE(achal): Draws the wall into the occlusion buffer, see DrawOccluder.
+    DepthPipeline occluder_pipeline;
+    OcclusionBuffer* occlusion_buffer = NULL;
+};
+
+#define OCCLUDER_SCENE_H
+#endif
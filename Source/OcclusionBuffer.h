@@ -0,0 +1,209 @@
+#ifndef OCCLUSION_BUFFER_H
+
+#include "Core/Types.h"
+#include "IndexedTriangleList.h"
+#include "ScreenRect.h"
+#include "ZBuffer.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// NOTE(achal): Same NDC to pixel mapping as the framebuffer, at a much lower resolution: every pixel here covers a
+// 3 x 6 block of a 768 x 768 screen.
+#define OCCLUSION_BUFFER_WIDTH 256
+#define OCCLUSION_BUFFER_HEIGHT 128
+
+// NOTE(achal): Boxes reaching any nearer than this to the camera never get culled.
+#define MIN_OCCLUDEE_DEPTH 1e-3f
+
+// NOTE(achal): Vertex shaders which declare `static const b32 transforms_affinely = true;` promise that their
+// TransformPosition (see TransformsPositions) is an affine map, the model matrix and nothing else. The transformed
+// corners of a box around the vertices then bound everything the vertex shader could output, and an occlusion test
+// of the box is a test of the mesh. Vertex shaders that move vertices around on their own never get culled.
+template <typename VertexShader, typename = void>
+struct TransformsAffinely : std::false_type {};
+
+template <typename VertexShader>
+struct TransformsAffinely<VertexShader, typename std::enable_if<VertexShader::transforms_affinely>::type> : std::true_type {};
+
+// NOTE(achal): Axis aligned, in object space.
+struct BoundingBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+template <typename Vertex>
+inline BoundingBox ComputeBoundingBox(const IndexedTriangleList<Vertex>& it_list)
+{
+    f32 infinity = std::numeric_limits<f32>::infinity();
+    BoundingBox box = { glm::vec3(infinity), glm::vec3(-infinity) };
+    for (const Vertex& v : it_list.vertices)
+    {
+        box.min = glm::min(box.min, v.position);
+        box.max = glm::max(box.max, v.position);
+    }
+    return box;
+}
+
+// NOTE(achal): Software occlusion culling. A few designated occluders, big things that hide a lot, get their depth
+// drawn into a small z buffer first, with a DepthPipeline using COVERAGE_RULE_UNDERESTIMATE: only pixels an occluder
+// covers entirely, at the farthest depth the occluder has anywhere in them. Every depth in here is then a depth nothing
+// behind it can show through at, however coarse the pixels.
+//
+// Pipelines with an occlusion buffer test the bounding box of every mesh against it before running the vertex
+// shader, and skip the mesh if the box is behind the occluders everywhere it lands.
+struct OcclusionBuffer
+{
+    void Initialize(u32 width, u32 height)
+    {
+        z_values.resize((size_t)width * (size_t)height);
+        z_buffer.width = width;
+        z_buffer.height = height;
+        z_buffer.z_values = z_values.data();
+        Clear();
+    }
+
+    // Starts a new frame, the occluders have to be drawn again. The bounds of meshes that weren't tested last frame
+    // are dropped.
+    void Clear()
+    {
+        std::fill(z_values.begin(), z_values.end(), std::numeric_limits<f32>::infinity());
+
+        for (auto it = bounds.begin(); it != bounds.end();)
+        {
+            if (it->second.is_used)
+            {
+                it->second.is_used = false;
+                ++it;
+            }
+            else
+            {
+                it = bounds.erase(it);
+            }
+        }
+    }
+
+    // True if nothing vertex_shader makes out of it_list can be seen past the occluders. The bounding box of the
+    // vertices is computed once per version of the list.
+    template <typename Vertex, typename VertexShader>
+    b32 IsOccluded(const IndexedTriangleList<Vertex>& it_list, const VertexShader& vertex_shader)
+    {
+        return IsOccluded(it_list, vertex_shader, TransformsAffinely<VertexShader>());
+    }
+
+    // True if the box, whose corners are given in view space, is entirely behind the occluders.
+    b32 IsBoxOccluded(const glm::vec3* corners, u32 corner_count) const
+    {
+        f32 half_width = (f32)z_buffer.width / 2.f;
+        f32 half_height = (f32)z_buffer.height / 2.f;
+
+        f32 min_x = std::numeric_limits<f32>::infinity();
+        f32 min_y = std::numeric_limits<f32>::infinity();
+        f32 max_x = -std::numeric_limits<f32>::infinity();
+        f32 max_y = -std::numeric_limits<f32>::infinity();
+        f32 nearest_depth = std::numeric_limits<f32>::infinity();
+        for (u32 i = 0; i < corner_count; ++i)
+        {
+            // NOTE(achal): Nothing gets clipped at the camera, a box reaching up to or behind it can't be projected.
+            f32 depth = -corners[i].z;
+            if (!(depth > MIN_OCCLUDEE_DEPTH))
+                return false;
+
+            // NOTE(achal): Pipeline::ToScreenSpace.
+            f32 x = (corners[i].x / depth + 1.f) * half_width;
+            f32 y = (-corners[i].y / depth + 1.f) * half_height;
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+            nearest_depth = std::min(nearest_depth, depth);
+        }
+
+        // NOTE(achal): Every pixel the projected box touches, however little.
+        ScreenRect rect;
+        rect.min_x = (int)std::max(std::floor(min_x), 0.f);
+        rect.min_y = (int)std::max(std::floor(min_y), 0.f);
+        rect.max_x = (int)std::min(std::ceil(max_x), (f32)z_buffer.width);
+        rect.max_y = (int)std::min(std::ceil(max_y), (f32)z_buffer.height);
+
+        // NOTE(achal): Off screen, nothing to see there either.
+        if (rect.min_x >= rect.max_x || rect.min_y >= rect.max_y)
+            return true;
+
+        for (int y = rect.min_y; y < rect.max_y; ++y)
+        {
+            const f32* row = z_values.data() + (size_t)y * z_buffer.width;
+            for (int x = rect.min_x; x < rect.max_x; ++x)
+            {
+                if (!(row[x] < nearest_depth))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    // NOTE(achal): What occluder DepthPipelines draw into.
+    ZBuffer z_buffer = {};
+
+private:
+    template <typename Vertex, typename VertexShader>
+    b32 IsOccluded(const IndexedTriangleList<Vertex>& it_list, const VertexShader& vertex_shader, std::true_type)
+    {
+        if (it_list.vertices.empty())
+            return false;
+
+        CachedBounds& cached_bounds = bounds[it_list.id];
+        cached_bounds.is_used = true;
+        if (!cached_bounds.is_valid || cached_bounds.version != it_list.version ||
+            cached_bounds.vertex_count != it_list.vertices.size())
+        {
+            cached_bounds.box = ComputeBoundingBox(it_list);
+            cached_bounds.version = it_list.version;
+            cached_bounds.vertex_count = it_list.vertices.size();
+            cached_bounds.is_valid = true;
+        }
+
+        const BoundingBox& box = cached_bounds.box;
+        glm::vec3 corners[8];
+        for (u32 i = 0; i < 8; ++i)
+        {
+            Vertex corner = {};
+            corner.position.x = (i & 1) ? box.max.x : box.min.x;
+            corner.position.y = (i & 2) ? box.max.y : box.min.y;
+            corner.position.z = (i & 4) ? box.max.z : box.min.z;
+            corners[i] = vertex_shader.TransformPosition(corner);
+        }
+
+        return IsBoxOccluded(corners, 8);
+    }
+
+    template <typename Vertex, typename VertexShader>
+    b32 IsOccluded(const IndexedTriangleList<Vertex>&, const VertexShader&, std::false_type)
+    {
+        return false;
+    }
+
+    struct CachedBounds
+    {
+        BoundingBox box;
+        u64 version;
+        size_t vertex_count;
+        b32 is_valid = false;
+        b32 is_used = false;
+    };
+
+    // NOTE(achal): Keyed by IndexedTriangleList::id.
+    std::unordered_map<u64, CachedBounds> bounds;
+
+    std::vector<f32> z_values;
+};
+
+#define OCCLUSION_BUFFER_H
+#endif
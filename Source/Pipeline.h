@@ -1,17 +1,55 @@
 #ifndef PIPELINE_H
 
 #include "Core/Types.h"
+#include "Core/Hash.h"
+#include "DirtyTileTracker.h"
+#include "EdgeEquation.h"
 #include "IndexedTriangleList.h"
 #include "Framebuffer.h"
+#include "OcclusionBuffer.h"
+#include "RenderQueue.h"
 #include "ZBuffer.h"
+#include "ScreenRect.h"
 #include "Texture.h"
 #include "Triangle.h"
 
 #include <glm/glm.hpp>
 #include <algorithm>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
-#define TEXTURE_WRAP 1
+// NOTE(achal): Number of pixels of a scanline that are depth tested, shaded and stored together.
+#define SPAN_CHUNK_WIDTH 8
+
+// NOTE(achal): Pixel shaders which declare `static const b32 uses_derivatives = true;` are called as
+// pixel_shader(in, ddx, ddy), where ddx and ddy are the screen-space derivatives of the (perspective correct)
+// input, evaluated once per 2x2 pixel quad like on GPUs. Everybody else is called as pixel_shader(in).
+template <typename PixelShader, typename = void>
+struct UsesDerivatives : std::false_type {};
+
+template <typename PixelShader>
+struct UsesDerivatives<PixelShader, typename std::enable_if<PixelShader::uses_derivatives>::type> : std::true_type {};
+
+// NOTE(achal): Pixel shaders which declare `static const b32 shades_batches = true;` shade a whole chunk of a span
+// in one call, ShadeBatch(in, ddx, ddy, count, mask, colors), and only have to fill colors[i] for the bits set in
+// mask. ddx and ddy are only filled in if the pixel shader also uses derivatives.
+template <typename PixelShader, typename = void>
+struct ShadesBatches : std::false_type {};
+
+template <typename PixelShader>
+struct ShadesBatches<PixelShader, typename std::enable_if<PixelShader::shades_batches>::type> : std::true_type {};
+
+// NOTE(achal): Pixel shaders whose output depends on more than their input, a bound texture for example, declare
+// `static const b32 has_state_signature = true;` and return a hash of that state from GetStateSignature(). It tells
+// the DirtyTileTracker when the pixels of otherwise identical triangles change.
+template <typename PixelShader, typename = void>
+struct HasStateSignature : std::false_type {};
+
+template <typename PixelShader>
+struct HasStateSignature<PixelShader, typename std::enable_if<PixelShader::has_state_signature>::type> : std::true_type {};
 
 template <typename Effect>
 struct Pipeline
@@ -20,15 +58,177 @@ struct Pipeline
     typedef typename Effect::VertexShader::VertexOut VSOut;
     typedef typename Effect::GeometryShader::VertexOut GSOut;
 
+    // NOTE(achal): A triangle ready to be rasterized. Rasterizing only reads it and doesn't write to the pipeline
+    // either, so any number of threads can rasterize at once, each into its own part of the screen.
+    struct ScreenTriangle
+    {
+        Triangle<GSOut> triangle;
+
+        // NOTE(achal): Pixels whose centers, or any of whose samples when multisampling, are inside the snapped
+        // bounding box, and inside the clip rect (see GetClipRect). Empty if the triangle can't cover any.
+        ScreenRect bounds;
+
+        // NOTE(achal): Whether the whole triangle, not only the part of it inside the clip rect, FitsInStamp. A big
+        // triangle clipped down to a few pixels still has edge values too large for GetStampCoverage.
+        b32 fits_in_stamp;
+
+        EdgeEquation edges[3];
+
+        // NOTE(achal): Screen-space gradients of the (linearly interpolated) attributes. Attributes are evaluated
+        // from these at every pixel, rather than stepped along from some edge, so a pixel gets the exact same
+        // attributes however the screen is split up.
+        GSOut gradient_x;
+        GSOut gradient_y;
+
+        // NOTE(achal): HashBytes of triangle.
+        u64 hash;
+    };
+
+    // NOTE(achal): The stages run in order: ShadeVertices, AssembleTriangles (assembly, culling, the geometry shader
+    // and mapping to screen space), SetupTriangle and then either rasterization right away, or binning into the
+    // screen tiles of the tile tracker which rasterizes them later on the job pool, see DirtyTileTracker. The stages
+    // before rasterization only run when the mesh or their uniforms changed, see GetScreenTriangles. With a render
+    // queue, what comes after setup waits until the queue gets to this draw, see RenderQueue.
     void Draw(const IndexedTriangleList<Vertex>& it_list)
     {
-        f32 half_width = (f32)framebuffer->width / 2.f;
-        f32 half_height = (f32)framebuffer->height / 2.f;
+        // NOTE(achal): Before the vertex shader, the whole point is to not run it.
+        if (occlusion_buffer && occlusion_buffer->IsOccluded(it_list, effect.vertex_shader))
+            return;
+
+        std::shared_ptr<const std::vector<ScreenTriangle>> triangles = GetScreenTriangles(it_list);
+        if (triangles->empty())
+            return;
+
+        // NOTE(achal): Identical triangles drawn by different pipelines, with a different depth test, coverage rule,
+        // scissor or pixel shader state, don't give identical pixels. All of it is captured as it is now, the next
+        // frame may change it while this one is still being rasterized.
+        DepthTest draw_depth_test = depth_test;
+        const Pipeline* pipeline = this;
+        u64 state_signature = HashBytes(&pipeline, sizeof(pipeline));
+        state_signature = HashBytes(&draw_depth_test, sizeof(draw_depth_test), state_signature);
+        state_signature = HashBytes(&coverage_rule, sizeof(coverage_rule), state_signature);
+        ScreenRect clip_rect = GetClipRect();
+        state_signature = HashBytes(&clip_rect, sizeof(clip_rect), state_signature);
+        state_signature = GetStateSignature(state_signature, HasStateSignature<typename Effect::PixelShader>());
+
+        if (!render_queue)
+        {
+            Submit(triangles, draw_depth_test, state_signature);
+            return;
+        }
+
+        // NOTE(achal): position.z is 1 / depth, the nearest vertex has the largest.
+        f32 nearest_z = 0.f;
+        for (const ScreenTriangle& screen_triangle : *triangles)
+        {
+            const Triangle<GSOut>& triangle = screen_triangle.triangle;
+            nearest_z = std::max(nearest_z, std::max(triangle.v0.position.z,
+                std::max(triangle.v1.position.z, triangle.v2.position.z)));
+        }
+
+        render_queue->Add(RENDER_QUEUE_LAYER_OPAQUE, 1.f / nearest_z,
+            [this, triangles, draw_depth_test, state_signature]()
+        {
+            Submit(triangles, draw_depth_test, state_signature);
+        });
+    }
+
+    // Rasterizes the triangles right away, or bins them into the tile tracker to be rasterized later.
+    void Submit(const std::shared_ptr<const std::vector<ScreenTriangle>>& triangles, DepthTest draw_depth_test,
+        u64 state_signature)
+    {
+        if (!tile_tracker)
+        {
+            ScreenRect clip_rect = { 0, 0, framebuffer->width, framebuffer->height };
+            for (const ScreenTriangle& screen_triangle : *triangles)
+                DrawTriangle(screen_triangle, clip_rect, draw_depth_test);
+            return;
+        }
+
+        u32 draw_index = tile_tracker->AddDraw([this, triangles, draw_depth_test](const ScreenRect& rect,
+            const DirtyTileTracker::BinEntry* entries, u32 count)
+        {
+            for (u32 i = 0; i < count; ++i)
+                DrawTriangle((*triangles)[entries[i].triangle_index], rect, draw_depth_test);
+        });
 
-        std::vector<VSOut> transformed_vertices(it_list.vertices.size());
+        for (u32 i = 0; i < (u32)triangles->size(); ++i)
+        {
+            const ScreenTriangle& screen_triangle = (*triangles)[i];
+            u64 triangle_hash = HashBytes(&state_signature, sizeof(state_signature), screen_triangle.hash);
+            tile_tracker->AddTriangle(screen_triangle.bounds, triangle_hash, draw_index, i);
+        }
+    }
+
+    // Runs the stages before rasterization over it_list. Unless nothing any of them depends on changed since the
+    // last time they ran for it, in which case the triangles from back then are returned as they are.
+    std::shared_ptr<const std::vector<ScreenTriangle>> GetScreenTriangles(const IndexedTriangleList<Vertex>& it_list)
+    {
+        u64 key = HashBytes(&it_list.version, sizeof(it_list.version));
+        size_t counts[2] = { it_list.vertices.size(), it_list.indices.size() };
+        key = HashBytes(counts, sizeof(counts), key);
+        key = HashUniforms(effect.vertex_shader, key, std::is_empty<typename Effect::VertexShader>());
+        key = HashUniforms(effect.geometry_shader, key, std::is_empty<typename Effect::GeometryShader>());
+        int framebuffer_format[3] = { framebuffer->width, framebuffer->height, framebuffer->sample_count };
+        key = HashBytes(framebuffer_format, sizeof(framebuffer_format), key);
+        key = HashBytes(&coverage_rule, sizeof(coverage_rule), key);
+        ScreenRect draw_rects[2] = { GetViewport(), GetClipRect() };
+        key = HashBytes(draw_rects, sizeof(draw_rects), key);
+
+        DrawCache& cache = draw_caches[it_list.id];
+        cache.is_used = true;
+        if (cache.triangles && cache.key == key)
+            return cache.triangles;
+
+        // NOTE(achal): The tile tracker may still be rasterizing the old triangles.
+        if (!cache.triangles || cache.triangles.use_count() > 1)
+            cache.triangles = std::make_shared<std::vector<ScreenTriangle>>();
+        cache.key = key;
+
+        std::vector<ScreenTriangle>& triangles = *cache.triangles;
+        triangles.clear();
+
+        ShadeVertices(it_list);
+        AssembleTriangles(it_list, draw_rects[0], &triangles);
+
+        size_t kept_count = 0;
+        for (ScreenTriangle& screen_triangle : triangles)
+        {
+            if (SetupTriangle(&screen_triangle, draw_rects[1]))
+                triangles[kept_count++] = screen_triangle;
+        }
+        triangles.resize(kept_count);
+
+        return cache.triangles;
+    }
+
+    // Drops what GetScreenTriangles holds on to for the meshes that weren't drawn since the last call, call it once
+    // every frame after drawing. Deferred draws of the tile tracker keep their triangles alive as long as they need.
+    void EndFrame()
+    {
+        for (auto it = draw_caches.begin(); it != draw_caches.end();)
+        {
+            if (it->second.is_used)
+            {
+                it->second.is_used = false;
+                ++it;
+            }
+            else
+            {
+                it = draw_caches.erase(it);
+            }
+        }
+    }
+
+    void ShadeVertices(const IndexedTriangleList<Vertex>& it_list)
+    {
+        transformed_vertices.resize(it_list.vertices.size());
         std::transform(it_list.vertices.begin(), it_list.vertices.end(), transformed_vertices.begin(), effect.vertex_shader);
+    }
 
-        // Assemble Triangles
+    void AssembleTriangles(const IndexedTriangleList<Vertex>& it_list, const ScreenRect& draw_viewport,
+        std::vector<ScreenTriangle>* triangles)
+    {
         for (size_t i = 0; i < it_list.indices.size() / 3; ++i)
         {
             size_t idx0 = it_list.indices[3 * i];
@@ -43,155 +243,490 @@ struct Pipeline
 
             if (!should_cull)
             {
-                Triangle<GSOut> triangle = effect.geometry_shader(&v0, &v1, &v2, i);
+                ScreenTriangle screen_triangle;
+                Triangle<GSOut>& triangle = screen_triangle.triangle;
+                triangle = effect.geometry_shader(&v0, &v1, &v2, i);
 
                 // World (View) Space to Screen Space
-                ToScreenSpace(&triangle.v0, half_width, half_height);
-                ToScreenSpace(&triangle.v1, half_width, half_height);
-                ToScreenSpace(&triangle.v2, half_width, half_height);
+                ToScreenSpace(&triangle.v0, draw_viewport);
+                ToScreenSpace(&triangle.v1, draw_viewport);
+                ToScreenSpace(&triangle.v2, draw_viewport);
 
-                DrawTriangle(&triangle);
+                triangles->push_back(screen_triangle);
             }
         }
     }
 
-    void DrawTriangle(Triangle<GSOut>* triangle)
+    // Computes everything about a screen space triangle that doesn't depend on where it gets rasterized, with its
+    // bounds kept within clip_rect. Returns false if there's nothing to rasterize.
+    b32 SetupTriangle(ScreenTriangle* screen_triangle, const ScreenRect& clip_rect)
     {
-        VSOut* v0 = &triangle->v0;
-        VSOut* v1 = &triangle->v1;
-        VSOut* v2 = &triangle->v2;
+        const Triangle<GSOut>& triangle = screen_triangle->triangle;
 
-        // NOTE(achal): Sort the vertices so that v0 will be at the top (lowest y) and v2 will be at the bottom (highest y).
-        if (v0->position.y > v1->position.y) std::swap(v0, v1);
-        if (v1->position.y > v2->position.y) std::swap(v1, v2);
-        if (v0->position.y > v1->position.y) std::swap(v0, v1);
+        f32 x[3] = { triangle.v0.position.x, triangle.v1.position.x, triangle.v2.position.x };
+        f32 y[3] = { triangle.v0.position.y, triangle.v1.position.y, triangle.v2.position.y };
+        if (!SetupEdges(x, y, framebuffer->sample_count, coverage_rule, screen_triangle->edges,
+            &screen_triangle->bounds))
+            return false;
 
-        if (v0->position.y == v1->position.y)
-        {
-            // NOTE(achal): Sort the vertices so that v0 is left of v1
-            if (v0->position.x > v1->position.x)
-                std::swap(v0, v1);
+        screen_triangle->fits_in_stamp = FitsInStamp(screen_triangle->bounds);
 
-            DrawFlatTopTriangle(*v0, *v1, *v2);
-        }
-        else if (v1->position.y == v2->position.y)
+        // NOTE(achal): Everything from binning down to the spans only ever looks within the bounds.
+        screen_triangle->bounds = Intersect(screen_triangle->bounds, clip_rect);
+        if (IsEmpty(screen_triangle->bounds))
+            return false;
+
+        ComputeGradients(triangle.v0, triangle.v1, triangle.v2, &screen_triangle->gradient_x,
+            &screen_triangle->gradient_y);
+
+        // NOTE(achal): The screen space vertices, all of their attributes included, decide every pixel the triangle
+        // ends up covering.
+        screen_triangle->hash = HashBytes(&triangle, sizeof(triangle));
+        return true;
+    }
+
+    // NOTE(achal): A shader's uniforms are its members. They get hashed as raw bytes, so shaders must be plain data
+    // without any padding or pointers in them.
+    template <typename Shader>
+    inline static u64 HashUniforms(const Shader& shader, u64 seed, std::false_type)
+    {
+        static_assert(std::is_trivially_copyable<Shader>::value, "Shader uniforms must be plain data");
+        return HashBytes(&shader, sizeof(shader), seed);
+    }
+
+    template <typename Shader>
+    inline static u64 HashUniforms(const Shader&, u64 seed, std::true_type)
+    {
+        return seed;
+    }
+
+    inline u64 GetStateSignature(u64 seed, std::false_type)
+    {
+        return seed;
+    }
+
+    inline u64 GetStateSignature(u64 seed, std::true_type)
+    {
+        u64 pixel_shader_signature = effect.pixel_shader.GetStateSignature();
+        return HashBytes(&pixel_shader_signature, sizeof(pixel_shader_signature), seed);
+    }
+
+    // Rasterizes the part of the triangle inside clip_rect, one row at a time. The edge equations give every row's
+    // span of covered pixels exactly, so there's no coverage left to test for the pixels in it. Tiny triangles go
+    // through DrawStamp and big ones through DrawBlocks instead.
+    void DrawTriangle(const ScreenTriangle& screen_triangle, const ScreenRect& clip_rect, DepthTest depth_test)
+    {
+        int x_min = std::max(screen_triangle.bounds.min_x, clip_rect.min_x);
+        int x_max = std::min(screen_triangle.bounds.max_x, clip_rect.max_x);
+        int y_min = std::max(screen_triangle.bounds.min_y, clip_rect.min_y);
+        int y_max = std::min(screen_triangle.bounds.max_y, clip_rect.max_y);
+        if (x_min >= x_max || y_min >= y_max)
+            return;
+
+        if (framebuffer->sample_count > 1)
         {
-            // NOTE(achal): Sort the vertices so that v1 is left of v2
-            if (v1->position.x > v2->position.x)
-                std::swap(v1, v2);
+            ScreenRect rect = { x_min, y_min, x_max, y_max };
+            DrawMultisampled(rect, screen_triangle, depth_test);
+            return;
+        }
 
-            DrawFlatBottomTriangle(*v0, *v1, *v2);
+        // NOTE(achal): Finely tessellated meshes are mostly triangles of a pixel or two, for which working out the
+        // spans, three divisions per edge and row, costs more than the pixels themselves.
+        if (screen_triangle.fits_in_stamp)
+        {
+            DrawStamp(x_min, y_min, x_max - x_min, y_max - y_min, screen_triangle, depth_test);
+            return;
         }
-        else
+
+        // NOTE(achal): Anything less than two blocks across either way can't have a block entirely inside.
+        if (x_max - x_min >= 2 * RASTER_BLOCK_SIZE && y_max - y_min >= 2 * RASTER_BLOCK_SIZE)
         {
-            f32 alpha = (f32)(v1->position.y - v0->position.y) / (f32)(v2->position.y - v0->position.y);
-            VSOut split_vertex = *v0 + (*v2 - *v0) * alpha;
+            ScreenRect rect = { x_min, y_min, x_max, y_max };
+            DrawBlocks(rect, screen_triangle, depth_test);
+            return;
+        }
 
-            if (split_vertex.position.x > v1->position.x)
+        const EdgeEquation* edges = screen_triangle.edges;
+        s64 row_values[3];
+        for (int i = 0; i < 3; ++i)
+            row_values[i] = edges[i].b * y_min + edges[i].c;
+
+        for (int y = y_min; y < y_max; ++y)
+        {
+            int start = x_min;
+            int end = x_max;
+            for (int i = 0; i < 3; ++i)
             {
-                // Major Right
-                DrawFlatBottomTriangle(*v0, *v1, split_vertex);
-                DrawFlatTopTriangle(*v1, split_vertex, *v2);
+                ClipSpanToEdge(edges[i], row_values[i], &start, &end);
+                row_values[i] += edges[i].b;
             }
-            else
+
+            if (start < end)
+                DrawSpan(y, start, end, screen_triangle, depth_test);
+        }
+    }
+
+    // Rasterizes the part of the triangle inside rect one RASTER_BLOCK_SIZE block at a time. Blocks outside any of
+    // the edges are skipped and blocks inside all of them are filled right away, only the rows of the blocks an edge
+    // crosses get clipped to that edge.
+    void DrawBlocks(const ScreenRect& rect, const ScreenTriangle& screen_triangle, DepthTest depth_test)
+    {
+        const EdgeEquation* edges = screen_triangle.edges;
+
+        for (int block_y = rect.min_y & ~(RASTER_BLOCK_SIZE - 1); block_y < rect.max_y; block_y += RASTER_BLOCK_SIZE)
+        {
+            for (int block_x = rect.min_x & ~(RASTER_BLOCK_SIZE - 1); block_x < rect.max_x; block_x += RASTER_BLOCK_SIZE)
             {
-                // Major Left
-                DrawFlatBottomTriangle(*v0, split_vertex, *v1);
-                DrawFlatTopTriangle(split_vertex, *v1, *v2);
+                ScreenRect block;
+                block.min_x = std::max(block_x, rect.min_x);
+                block.min_y = std::max(block_y, rect.min_y);
+                block.max_x = std::min(block_x + RASTER_BLOCK_SIZE, rect.max_x);
+                block.max_y = std::min(block_y + RASTER_BLOCK_SIZE, rect.max_y);
+
+                const EdgeEquation* crossing_edges[3];
+                int crossing_edge_count = 0;
+                b32 is_outside = false;
+                for (int i = 0; i < 3; ++i)
+                {
+                    EdgeCoverage coverage = GetRectEdgeCoverage(edges[i], block);
+                    if (coverage == EDGE_COVERAGE_NONE)
+                    {
+                        is_outside = true;
+                        break;
+                    }
+
+                    if (coverage == EDGE_COVERAGE_PARTIAL)
+                        crossing_edges[crossing_edge_count++] = &edges[i];
+                }
+
+                if (is_outside)
+                    continue;
+
+                for (int y = block.min_y; y < block.max_y; ++y)
+                {
+                    int start = block.min_x;
+                    int end = block.max_x;
+                    for (int i = 0; i < crossing_edge_count; ++i)
+                        ClipSpanToEdge(*crossing_edges[i], crossing_edges[i]->b * y + crossing_edges[i]->c, &start, &end);
+
+                    if (start < end)
+                        DrawSpan(y, start, end, screen_triangle, depth_test);
+                }
             }
         }
     }
 
-    // NOTE(achal): Vertex Order Assumption:
-    //
-    //        v0
-    //        /\
-    //       /  \
-    //      /    \
-    //   v1 ------ v2
-
-    void DrawFlatBottomTriangle(const GSOut& v0, const GSOut& v1, const GSOut& v2)
+    // Draws the width x height pixels starting at (x, y) of a triangle that FitsInStamp, with the coverage of all of
+    // them computed up front.
+    void DrawStamp(int x, int y, int width, int height, const ScreenTriangle& screen_triangle, DepthTest depth_test)
     {
-        f32 rcp_dy = 1.f / (v2.position.y - v0.position.y);
+        u32 row_masks[SMALL_TRIANGLE_STAMP_SIZE];
+        GetStampCoverage(screen_triangle.edges, x, y, width, height, row_masks);
+
+        const GSOut& v0 = screen_triangle.triangle.v0;
+        for (int row = 0; row < height; ++row)
+        {
+            if (!row_masks[row])
+                continue;
 
-        GSOut dv0 = (v1 - v0) * rcp_dy;
-        GSOut dv1 = (v2 - v0) * rcp_dy;
+            GSOut row_origin = v0 + screen_triangle.gradient_y * ((f32)(y + row) + 0.5f - v0.position.y);
+            DrawChunk(x, y + row, width, row_masks[row], row_origin, screen_triangle, depth_test);
+        }
+    }
 
-        // Initialize right edge interpolant
-        GSOut interp_right = v0;
+    void DrawSpan(int y, int start, int end, const ScreenTriangle& screen_triangle, DepthTest depth_test)
+    {
+        const GSOut& v0 = screen_triangle.triangle.v0;
+        GSOut row_origin = v0 + screen_triangle.gradient_y * ((f32)y + 0.5f - v0.position.y);
 
-        DrawFlatTriangle(v0, v1, v2, dv0, dv1, interp_right);
+        // NOTE(achal): The span is processed SPAN_CHUNK_WIDTH pixels at a time.
+        for (int x = start; x < end; x += SPAN_CHUNK_WIDTH)
+        {
+            int count = std::min(SPAN_CHUNK_WIDTH, end - x);
+            DrawChunk(x, y, count, (1u << count) - 1, row_origin, screen_triangle, depth_test);
+        }
     }
 
-    // NOTE(achal): Vertex Order Assumption:
-    //
-    //   v0 ------ v1
-    //      \    /
-    //       \  /
-    //        \/
-    //        v2
-    //
+    // Draws those of the count pixels starting at (x, y) whose bit is set in coverage: interpolate, depth test the
+    // whole chunk at once and then shade and store only the pixels which survived. row_origin holds the attributes
+    // of the row at v0's x.
+    inline void DrawChunk(int x, int y, int count, u32 coverage, const GSOut& row_origin,
+        const ScreenTriangle& screen_triangle, DepthTest depth_test)
+    {
+        const GSOut& v0 = screen_triangle.triangle.v0;
+        const GSOut& gradient_x = screen_triangle.gradient_x;
 
-    void DrawFlatTopTriangle(const GSOut& v0, const GSOut& v1, const GSOut& v2)
+        GSOut attributes[SPAN_CHUNK_WIDTH];
+        f32 z[SPAN_CHUNK_WIDTH];
+        u32 colors[SPAN_CHUNK_WIDTH];
+
+        for (int i = 0; i < count; ++i)
+        {
+            if ((coverage >> i) & 1)
+            {
+                attributes[i] = row_origin + gradient_x * ((f32)(x + i) + 0.5f - v0.position.x);
+                z[i] = 1.f / attributes[i].position.z;
+            }
+            else
+            {
+                // NOTE(achal): Fails the depth test against anything, and leaves the depth as it is.
+                z[i] = std::numeric_limits<f32>::infinity();
+            }
+        }
+
+        f32* depth_row = z_buffer->GetRow((u32)y);
+        // NOTE(achal): The infinite depth of the pixels that aren't covered would pass an equality test against a
+        // cleared buffer.
+        u32 mask = ZBuffer::TestSpan(depth_row, (u32)x, (u32)count, z, depth_test) & coverage;
+        if (!mask)
+            return;
+
+        ShadeChunk(attributes, z, x, y, count, mask, colors, screen_triangle,
+            ShadesBatches<typename Effect::PixelShader>());
+
+        Framebuffer::StoreSpanMasked(framebuffer->GetRow(y), x, count, colors, mask);
+    }
+
+    // Rasterizes the part of the triangle inside rect into multisampled buffers. Every sample is a pixel center
+    // moved by its offset, so each of them gets its own span per row, and a pixel is drawn if any of its samples is in
+    // their span. The pixel shader still runs once per pixel, at the center, and its color goes to every sample that
+    // is covered and passes the depth test.
+    void DrawMultisampled(const ScreenRect& rect, const ScreenTriangle& screen_triangle, DepthTest depth_test)
     {
-        f32 rcp_dy = 1.f / (v2.position.y - v0.position.y);
+        static_assert(SPAN_CHUNK_WIDTH * MSAA_SAMPLE_COUNT <= 32, "The samples of a chunk must fit in a u32 mask");
+
+        const EdgeEquation* edges = screen_triangle.edges;
+        s64 row_values[MSAA_SAMPLE_COUNT][3];
+        for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+        {
+            for (int i = 0; i < 3; ++i)
+                row_values[sample][i] = edges[i].b * rect.min_y + edges[i].c + GetSampleEdgeOffset(edges[i], sample);
+        }
+
+        // NOTE(achal): 1 / depth is what's interpolated linearly, and so is what moves with the sample.
+        f32 sample_z_offsets[MSAA_SAMPLE_COUNT];
+        for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+        {
+            sample_z_offsets[sample] = (screen_triangle.gradient_x.position.z * (f32)msaa_sample_offsets[sample][0] +
+                screen_triangle.gradient_y.position.z * (f32)msaa_sample_offsets[sample][1]) / 16.f;
+        }
 
-        GSOut dv0 = (v2 - v0) * rcp_dy;
-        GSOut dv1 = (v2 - v1) * rcp_dy;
+        const GSOut& v0 = screen_triangle.triangle.v0;
+        for (int y = rect.min_y; y < rect.max_y; ++y)
+        {
+            int starts[MSAA_SAMPLE_COUNT];
+            int ends[MSAA_SAMPLE_COUNT];
+            int start = rect.max_x;
+            int end = rect.min_x;
+            for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+            {
+                starts[sample] = rect.min_x;
+                ends[sample] = rect.max_x;
+                for (int i = 0; i < 3; ++i)
+                {
+                    ClipSpanToEdge(edges[i], row_values[sample][i], &starts[sample], &ends[sample]);
+                    row_values[sample][i] += edges[i].b;
+                }
+
+                if (starts[sample] < ends[sample])
+                {
+                    start = std::min(start, starts[sample]);
+                    end = std::max(end, ends[sample]);
+                }
+            }
 
-        // Initialize right edge interpolant.
-        GSOut interp_right = v1;
+            if (start >= end)
+                continue;
 
-        DrawFlatTriangle(v0, v1, v2, dv0, dv1, interp_right);
+            GSOut row_origin = v0 + screen_triangle.gradient_y * ((f32)y + 0.5f - v0.position.y);
+            for (int x = start; x < end; x += SPAN_CHUNK_WIDTH)
+            {
+                int count = std::min(SPAN_CHUNK_WIDTH, end - x);
+
+                // NOTE(achal): Bit i * MSAA_SAMPLE_COUNT + sample is set if that sample of pixel x + i is covered.
+                u32 coverage = 0;
+                for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+                {
+                    int first = std::max(starts[sample], x) - x;
+                    int last = std::min(ends[sample], x + count) - x;
+                    for (int i = first; i < last; ++i)
+                        coverage |= 1u << (i * MSAA_SAMPLE_COUNT + sample);
+                }
+
+                if (coverage)
+                {
+                    DrawMultisampledChunk(x, y, count, coverage, sample_z_offsets, row_origin, screen_triangle,
+                        depth_test);
+                }
+            }
+        }
     }
 
-    void DrawFlatTriangle(const GSOut& v0, const GSOut& v1, const GSOut& v2, const GSOut& dv0,
-        const GSOut& dv1, GSOut interp_right)
+    inline void DrawMultisampledChunk(int x, int y, int count, u32 coverage, const f32* sample_z_offsets,
+        const GSOut& row_origin, const ScreenTriangle& screen_triangle, DepthTest depth_test)
     {
-        // Initialize left edge interpolant.
-        GSOut interp_left = v0;
-
-        int y_start = (int)std::ceilf(v0.position.y - 0.5f);
-        int y_end = (int)std::ceilf(v2.position.y - 0.5f);
-
-        // Add pre-step.
-        //
-        // NOTE(achal): While it is true that the position of v0 is not the same in both flat-top and flat-bottom
-        // triangle, what makes this work is, for the right edge interpolant in the flat-top triangle both v0 and
-        // v1 have the same y coordinate! So, substracting v0.position.y would work for all the cases, whereas
-        // subtracing v1.position.y would NOT work for all the cases.
-        interp_left += dv0 * ((f32)y_start + 0.5f - v0.position.y);
-        interp_right += dv1 * ((f32)y_start + 0.5f - v0.position.y);
-
-        for (int y = y_start; y < y_end; ++y, interp_left += dv0, interp_right += dv1)
+        const GSOut& v0 = screen_triangle.triangle.v0;
+        const GSOut& gradient_x = screen_triangle.gradient_x;
+
+        GSOut attributes[SPAN_CHUNK_WIDTH];
+        f32 z[SPAN_CHUNK_WIDTH];
+        u32 colors[SPAN_CHUNK_WIDTH];
+        f32 sample_z[SPAN_CHUNK_WIDTH * MSAA_SAMPLE_COUNT];
+        u32 sample_colors[SPAN_CHUNK_WIDTH * MSAA_SAMPLE_COUNT];
+
+        for (int i = 0; i < count; ++i)
+        {
+            u32 pixel_coverage = (coverage >> (i * MSAA_SAMPLE_COUNT)) & ((1u << MSAA_SAMPLE_COUNT) - 1);
+            if (pixel_coverage)
+            {
+                attributes[i] = row_origin + gradient_x * ((f32)(x + i) + 0.5f - v0.position.x);
+                z[i] = 1.f / attributes[i].position.z;
+            }
+
+            for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+            {
+                sample_z[i * MSAA_SAMPLE_COUNT + sample] = ((pixel_coverage >> sample) & 1) ?
+                    1.f / (attributes[i].position.z + sample_z_offsets[sample]) : std::numeric_limits<f32>::infinity();
+            }
+        }
+
+        f32* depth_row = z_buffer->GetRow((u32)y);
+        u32 sample_mask = ZBuffer::TestSpan(depth_row, (u32)(x * MSAA_SAMPLE_COUNT),
+            (u32)(count * MSAA_SAMPLE_COUNT), sample_z, depth_test) & coverage;
+        if (!sample_mask)
+            return;
+
+        u32 mask = 0;
+        for (int i = 0; i < count; ++i)
         {
-            int x_start = (int)std::ceilf(interp_left.position.x - 0.5f);
-            int x_end = (int)std::ceilf(interp_right.position.x - 0.5f);
+            if ((sample_mask >> (i * MSAA_SAMPLE_COUNT)) & ((1u << MSAA_SAMPLE_COUNT) - 1))
+                mask |= 1u << i;
+        }
+
+        ShadeChunk(attributes, z, x, y, count, mask, colors, screen_triangle,
+            ShadesBatches<typename Effect::PixelShader>());
 
-            DrawScanLine(y, x_start, x_end, interp_left, interp_right);
+        for (int i = 0; i < count; ++i)
+        {
+            for (int sample = 0; sample < MSAA_SAMPLE_COUNT; ++sample)
+                sample_colors[i * MSAA_SAMPLE_COUNT + sample] = colors[i];
         }
+
+        Framebuffer::StoreSpanMasked(framebuffer->GetRow(y), x * MSAA_SAMPLE_COUNT, count * MSAA_SAMPLE_COUNT,
+            sample_colors, sample_mask);
     }
 
-    void DrawScanLine(int y, int start, int end, const GSOut& interp_left, const GSOut& interp_right)
+    // Shades the pixels of the chunk starting at (x, y) whose bit is set in mask, one pixel at a time.
+    inline void ShadeChunk(const GSOut* attributes, const f32* z, int x, int y, int count, u32 mask, u32* colors,
+        const ScreenTriangle& screen_triangle, std::false_type)
     {
-        f32 dx = interp_right.position.x - interp_left.position.x;
+        for (int i = 0; i < count; ++i)
+        {
+            if ((mask >> i) & 1)
+            {
+                colors[i] = Shade(attributes[i], z[i], x + i, y, screen_triangle,
+                    UsesDerivatives<typename Effect::PixelShader>());
+            }
+        }
+    }
 
-        GSOut d_interp = (interp_right - interp_left) / dx;
-        GSOut interp = interp_left + d_interp * ((f32)start + 0.5f - interp_left.position.x);
+    // Shades the pixels of the chunk starting at (x, y) whose bit is set in mask, with one call to the pixel shader.
+    inline void ShadeChunk(const GSOut* attributes, const f32* z, int x, int y, int count, u32 mask, u32* colors,
+        const ScreenTriangle& screen_triangle, std::true_type)
+    {
+        GSOut in[SPAN_CHUNK_WIDTH];
+        GSOut ddx[SPAN_CHUNK_WIDTH];
+        GSOut ddy[SPAN_CHUNK_WIDTH];
 
-        for (int x = start; x < end; ++x, interp += d_interp)
+        for (int i = 0; i < count; ++i)
         {
-            // NOTE(achal): We're doing some unnecessary computations here by multiplying the z value to
-            // every vertex attribute of interp.
-            f32 z = 1.f / interp.position.z;
-            if (z_buffer->TestAndSet(x, y, z))
+            if ((mask >> i) & 1)
             {
-                framebuffer->PutPixel(x, y, effect.pixel_shader(interp * z));
+                in[i] = attributes[i] * z[i];
+                ComputeDerivatives(attributes[i], x + i, y, screen_triangle, &ddx[i], &ddy[i],
+                    UsesDerivatives<typename Effect::PixelShader>());
             }
         }
+
+        effect.pixel_shader.ShadeBatch(in, ddx, ddy, (u32)count, mask, colors);
+    }
+
+    inline u32 Shade(const GSOut& attributes, f32 z, int, int, const ScreenTriangle&, std::false_type)
+    {
+        // NOTE(achal): We're doing some unnecessary computations here by multiplying the z value to
+        // every vertex attribute of interp.
+        return effect.pixel_shader(attributes * z);
     }
 
-    inline static void ToScreenSpace(VSOut* v, f32 half_width, f32 half_height)
+    inline u32 Shade(const GSOut& attributes, f32 z, int x, int y, const ScreenTriangle& screen_triangle,
+        std::true_type)
+    {
+        GSOut ddx, ddy;
+        ComputeDerivatives(attributes, x, y, screen_triangle, &ddx, &ddy, std::true_type());
+        return effect.pixel_shader(attributes * z, ddx, ddy);
+    }
+
+    inline void ComputeDerivatives(const GSOut&, int, int, const ScreenTriangle&, GSOut*, GSOut*, std::false_type) {}
+
+    inline void ComputeDerivatives(const GSOut& attributes, int x, int y, const ScreenTriangle& screen_triangle,
+        GSOut* ddx, GSOut* ddy, std::true_type)
+    {
+        const GSOut& gradient_x = screen_triangle.gradient_x;
+        const GSOut& gradient_y = screen_triangle.gradient_y;
+
+        // NOTE(achal): Step back to the top-left pixel of the 2x2 quad this pixel belongs to and differentiate
+        // there, so all four pixels of a quad agree on the derivatives (and hence on the texture LOD).
+        GSOut quad_attributes = attributes - gradient_x * (f32)(x & 1) - gradient_y * (f32)(y & 1);
+        f32 quad_z = 1.f / quad_attributes.position.z;
+
+        // NOTE(achal): The attributes are interpolated divided by depth, i.e. a = A * q with q = 1 / depth. By the
+        // quotient rule, dA = (da - A * dq) / q = (da - A * dq) * depth.
+        GSOut quad_in = quad_attributes * quad_z;
+        *ddx = (gradient_x - quad_in * gradient_x.position.z) * quad_z;
+        *ddy = (gradient_y - quad_in * gradient_y.position.z) * quad_z;
+    }
+
+    // Computes the screen-space gradients of the (linearly interpolated) attributes across the triangle.
+    static void ComputeGradients(const GSOut& v0, const GSOut& v1, const GSOut& v2, GSOut* gradient_x, GSOut* gradient_y)
+    {
+        f32 dx1 = v1.position.x - v0.position.x;
+        f32 dy1 = v1.position.y - v0.position.y;
+        f32 dx2 = v2.position.x - v0.position.x;
+        f32 dy2 = v2.position.y - v0.position.y;
+
+        GSOut d1 = v1 - v0;
+        GSOut d2 = v2 - v0;
+
+        f32 area = dx1 * dy2 - dx2 * dy1;
+        if (area == 0.f)
+        {
+            // NOTE(achal): Degenerate, it won't cover any pixels anyway.
+            *gradient_x = d1 * 0.f;
+            *gradient_y = d1 * 0.f;
+            return;
+        }
+
+        f32 rcp_area = 1.f / area;
+        *gradient_x = (d1 * dy2 - d2 * dy1) * rcp_area;
+        *gradient_y = (d2 * dx1 - d1 * dx2) * rcp_area;
+    }
+
+    // The viewport in effect, the whole framebuffer unless viewport says otherwise.
+    inline ScreenRect GetViewport() const
+    {
+        ScreenRect framebuffer_rect = { 0, 0, framebuffer->width, framebuffer->height };
+        return IsEmpty(viewport) ? framebuffer_rect : viewport;
+    }
+
+    // The pixels draws may touch: the viewport, within the scissor, within the framebuffer.
+    inline ScreenRect GetClipRect() const
+    {
+        ScreenRect framebuffer_rect = { 0, 0, framebuffer->width, framebuffer->height };
+        ScreenRect clip_rect = Intersect(GetViewport(), framebuffer_rect);
+        return IsEmpty(scissor) ? clip_rect : Intersect(clip_rect, scissor);
+    }
+
+    inline static void ToScreenSpace(VSOut* v, const ScreenRect& draw_viewport)
     {
         // NOTE(achal): Since I'm looking down the negative z axis, all the z-coordinates would be negative.
         // We do not want to mirror the x and y coordinates about the y = x line when we do perspective divide
@@ -203,8 +738,10 @@ struct Pipeline
         // correctly to the object in perspective space (basically, avoid texture warping).
         *v *= rcp_abs_z;
 
-        v->position.x = (v->position.x + 1.f) * half_width;
-        v->position.y = (-v->position.y + 1.f) * half_height;
+        f32 half_width = (f32)(draw_viewport.max_x - draw_viewport.min_x) / 2.f;
+        f32 half_height = (f32)(draw_viewport.max_y - draw_viewport.min_y) / 2.f;
+        v->position.x = (f32)draw_viewport.min_x + (v->position.x + 1.f) * half_width;
+        v->position.y = (f32)draw_viewport.min_y + (-v->position.y + 1.f) * half_height;
         v->position.z = rcp_abs_z;
     }
 
@@ -255,6 +792,38 @@ struct Pipeline
     Effect effect;
     Framebuffer* framebuffer;
     ZBuffer* z_buffer;
+    DirtyTileTracker* tile_tracker = NULL;
+    RenderQueue* render_queue = NULL;
+
+    // NOTE(achal): Meshes found to be behind the occluders in here don't get drawn at all, see OcclusionBuffer.
+    OcclusionBuffer* occlusion_buffer = NULL;
+
+    // NOTE(achal): NDC [-1, 1] x [-1, 1] maps onto viewport, and nothing gets drawn outside of it, there being no
+    // clipping to NDC otherwise. Nor outside scissor, which only clips. Empty rects, the default for both, stand for
+    // the whole framebuffer. For drawing into part of the framebuffer only: split screen, picture in picture, or
+    // redrawing just a region of it.
+    ScreenRect viewport = {};
+    ScreenRect scissor = {};
+
+    // NOTE(achal): Single sampled framebuffers only, for anything other than COVERAGE_RULE_CENTER.
+    CoverageRule coverage_rule = COVERAGE_RULE_CENTER;
+
+    // NOTE(achal): DEPTH_TEST_EQUAL to draw over the depth a DepthPipeline laid down for the same meshes, see
+    // Engine::depth_pre_pass.
+    DepthTest depth_test = DEPTH_TEST_LESS;
+
+    // NOTE(achal): Per mesh drawn, keyed by its id, the triangles the vertex and geometry stages made out of it last
+    // time around and a hash of everything those depended on. The triangles are shared with the deferred draws of
+    // the tile tracker. Meshes that go a frame without being drawn lose theirs, see EndFrame.
+    struct DrawCache
+    {
+        u64 key;
+        std::shared_ptr<std::vector<ScreenTriangle>> triangles;
+        b32 is_used = false;
+    };
+    std::unordered_map<u64, DrawCache> draw_caches;
+
+    std::vector<VSOut> transformed_vertices;
 };
 
 #define PIPELINE_H
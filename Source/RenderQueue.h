@@ -0,0 +1,99 @@
+#ifndef RENDER_QUEUE_H
+
+#include "Core/Types.h"
+
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// NOTE(achal): Layers are submitted in order, whatever the depth of their draws. Depth-only draws go first, so a
+// depth pre-pass is complete before anything gets drawn over it.
+#define RENDER_QUEUE_LAYER_DEPTH 0
+#define RENDER_QUEUE_LAYER_OPAQUE 1
+
+// NOTE(achal): Collects the draws of a frame and submits them sorted front to back, by the view depth of the
+// nearest point of each, rather than in the order they were made. The depth test then gets to reject as much as it
+// can of everything behind, and fewer pixels get shaded.
+//
+// Sorting is an LSD radix sort of 32-bit keys, 8 bits at a time, which is stable: draws at the same quantized depth
+// keep the order they were made in.
+struct RenderQueue
+{
+    typedef std::function<void()> Submission;
+
+    // Queues submit to be called by Flush. nearest_depth is the distance along the view direction to the nearest
+    // point of whatever submit draws.
+    void Add(u32 layer, f32 nearest_depth, Submission submit)
+    {
+        Entry entry = { MakeKey(layer, nearest_depth), (u32)submissions.size() };
+        entries.push_back(entry);
+        submissions.push_back(std::move(submit));
+    }
+
+    // Calls every queued submission in order, layer by layer, front to back, and empties the queue.
+    void Flush()
+    {
+        SortEntries();
+
+        for (const Entry& entry : entries)
+            submissions[entry.index]();
+
+        entries.clear();
+        submissions.clear();
+    }
+
+    inline static u32 MakeKey(u32 layer, f32 nearest_depth)
+    {
+        // NOTE(achal): Positive floats sort the same as their bits do. Dropping the low 8 bits of the mantissa
+        // leaves 23 bits of depth, still plenty to order objects by, and the layer goes on top.
+        if (!(nearest_depth > 0.f))
+            nearest_depth = 0.f;
+
+        u32 depth_bits;
+        memcpy(&depth_bits, &nearest_depth, sizeof(depth_bits));
+        return (layer << 24) | (depth_bits >> 8);
+    }
+
+private:
+    struct Entry
+    {
+        u32 key;
+        u32 index;
+    };
+
+    void SortEntries()
+    {
+        scratch.resize(entries.size());
+        for (u32 shift = 0; shift < 32; shift += 8)
+        {
+            u32 counts[256] = {};
+            for (const Entry& entry : entries)
+                ++counts[(entry.key >> shift) & 0xFF];
+
+            // NOTE(achal): All keys share this byte, the pass wouldn't move anything.
+            if (counts[(entries.empty() ? 0 : entries[0].key >> shift) & 0xFF] == entries.size())
+                continue;
+
+            u32 offset = 0;
+            for (u32 i = 0; i < 256; ++i)
+            {
+                u32 count = counts[i];
+                counts[i] = offset;
+                offset += count;
+            }
+
+            for (const Entry& entry : entries)
+                scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+
+            std::swap(entries, scratch);
+        }
+    }
+
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+    std::vector<Submission> submissions;
+};
+
+#define RENDER_QUEUE_H
+#endif
@@ -0,0 +1,395 @@
+#ifndef SAMPLER_H
+
+#include "Core/Types.h"
+#include "Texture.h"
+
+#include <glm/glm.hpp>
+#include <cassert>
+#include <emmintrin.h>
+
+enum TextureAddressMode
+{
+    // Repeat the texture, coordinate 1.25 samples the same texel as 0.25.
+    TEXTURE_ADDRESS_WRAP,
+
+    // Clamp coordinates to the edge texels.
+    TEXTURE_ADDRESS_CLAMP,
+
+    // Repeat the texture, flipping every other repetition, coordinate 1.25 samples the same texel as 0.75.
+    TEXTURE_ADDRESS_MIRROR
+};
+
+enum TextureFilter
+{
+    // Nearest texel of the base level, no mip mapping.
+    TEXTURE_FILTER_NEAREST,
+
+    // Nearest texel of the nearest mip level.
+    TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST,
+
+    // Nearest texel of the two closest mip levels, blended linearly by the fractional LOD.
+    TEXTURE_FILTER_NEAREST_MIPMAP_LINEAR,
+
+    // Bilinear filtering of the base level, no mip mapping.
+    TEXTURE_FILTER_LINEAR,
+
+    // Bilinear filtering of the nearest mip level.
+    TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST,
+
+    // Bilinear filtering of the two closest mip levels, blended linearly by the fractional LOD (trilinear).
+    TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR
+};
+
+// NOTE(achal): All of the sampler state is known at compile time, so every sampler gets its own copy of the
+// sampling code with the addressing and filtering decided up front, instead of branching on them for every sample.
+// The only thing decided at runtime is whether the texture is a power of two, and that is done once per call,
+// not per sample. Power of two textures wrap with a bit mask.
+template <TextureAddressMode address_mode, TextureFilter filter, TextureFormat format>
+struct Sampler
+{
+    // The format textures have to be in for this sampler, see Texture::format.
+    static const TextureFormat texture_format = format;
+
+    // Samples a single texel. Results are packed 0x00RRGGBB.
+    inline static u32 Sample(const Texture& texture, f32 x, f32 y, f32 lod)
+    {
+        if (filter >= TEXTURE_FILTER_LINEAR)
+        {
+            u32 result;
+            SampleBatch(texture, &x, &y, &lod, 1, &result);
+            return result;
+        }
+
+        return texture.is_power_of_two ? SampleNearest<true>(texture, x, y, lod) : SampleNearest<false>(texture, x, y, lod);
+    }
+
+    // Samples count texels at once. Results are packed 0x00RRGGBB.
+    static void SampleBatch(const Texture& texture, const f32* x, const f32* y, const f32* lod, u32 count, u32* result)
+    {
+        if (filter < TEXTURE_FILTER_LINEAR)
+        {
+            if (texture.is_power_of_two)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    result[i] = SampleNearest<true>(texture, x[i], y[i], lod[i]);
+            }
+            else
+            {
+                for (u32 i = 0; i < count; ++i)
+                    result[i] = SampleNearest<false>(texture, x[i], y[i], lod[i]);
+            }
+            return;
+        }
+
+        if (texture.is_power_of_two)
+            SampleLinearBatch<true>(texture, x, y, lod, count, result);
+        else
+            SampleLinearBatch<false>(texture, x, y, lod, count, result);
+    }
+
+private:
+    template <b32 power_of_two>
+    inline static u32 SampleNearest(const Texture& texture, f32 x, f32 y, f32 lod)
+    {
+        const std::vector<TextureLevel>& levels = texture.levels;
+        assert(texture.format == format);
+
+        // NOTE(achal): Magnified samples (the common case for close-ups) never touch the smaller levels.
+        if (filter == TEXTURE_FILTER_NEAREST || lod <= 0.f)
+            return FetchNearest<power_of_two>(levels[0], x, y);
+
+        f32 max_lod = (f32)(levels.size() - 1);
+        lod = glm::min(lod, max_lod);
+
+        if (filter == TEXTURE_FILTER_NEAREST_MIPMAP_NEAREST)
+            return FetchNearest<power_of_two>(levels[(size_t)(lod + 0.5f)], x, y);
+
+        size_t level = (size_t)lod;
+        u32 texel0 = FetchNearest<power_of_two>(levels[level], x, y);
+        if (level == levels.size() - 1)
+            return texel0;
+
+        u32 texel1 = FetchNearest<power_of_two>(levels[level + 1], x, y);
+        return LerpTexel(texel0, texel1, (u32)((lod - (f32)level) * 256.f));
+    }
+
+    template <b32 power_of_two>
+    inline static u32 FetchNearest(const TextureLevel& level, f32 x, f32 y)
+    {
+        int texture_x = AddressNearest<power_of_two>(x, level.width);
+        int texture_y = AddressNearest<power_of_two>(y, level.height);
+
+        return FetchTexel(level, Texture::GetTexelIndex(level, texture_x, texture_y));
+    }
+
+    // Fetches the texel at the given index of the tiled layout.
+    inline static u32 FetchTexel(const TextureLevel& level, size_t index)
+    {
+        if (format == TEXTURE_FORMAT_BC1)
+        {
+            const u32* block_texels = BC1BlockCache::Decode(level.blocks[index >> (2 * TEXTURE_TILE_SIZE_LOG2)]);
+            return block_texels[index & (TEXTURE_TILE_TEXEL_COUNT - 1)];
+        }
+
+        return level.texels[index];
+    }
+
+    // Fetches two texels of the tiled layout widened to 16-bit lanes, the first one in the low half.
+    inline static __m128i FetchWideTexels(const TextureLevel& level, int index0, int index1)
+    {
+        if (format == TEXTURE_FORMAT_BC1)
+        {
+            // NOTE(achal): The two texels are vertical neighbours, 3 times out of 4 they're in the same block.
+            u64 block0 = level.blocks[index0 >> (2 * TEXTURE_TILE_SIZE_LOG2)];
+            u64 block1 = level.blocks[index1 >> (2 * TEXTURE_TILE_SIZE_LOG2)];
+            const u32* block_texels0 = BC1BlockCache::Decode(block0);
+            const u32* block_texels1 = block1 == block0 ? block_texels0 : BC1BlockCache::Decode(block1);
+
+            __m128i texels = _mm_setr_epi32((int)block_texels0[index0 & (TEXTURE_TILE_TEXEL_COUNT - 1)],
+                (int)block_texels1[index1 & (TEXTURE_TILE_TEXEL_COUNT - 1)], 0, 0);
+            return _mm_unpacklo_epi8(texels, _mm_setzero_si128());
+        }
+
+        return _mm_set_epi64x((long long)level.wide_texels[index1], (long long)level.wide_texels[index0]);
+    }
+
+    // Maps a normalized coordinate to the texel containing it.
+    template <b32 power_of_two>
+    inline static int AddressNearest(f32 coordinate, int size)
+    {
+        if (power_of_two)
+        {
+            int texel = FloorToInt(coordinate * (f32)size);
+            if (address_mode == TEXTURE_ADDRESS_WRAP)
+                return texel & (size - 1);
+
+            if (address_mode == TEXTURE_ADDRESS_MIRROR)
+            {
+                texel &= 2 * size - 1;
+                return texel < size ? texel : 2 * size - 1 - texel;
+            }
+        }
+        else
+        {
+            // NOTE(achal): Wrap (or mirror) in normalized space by dropping the integer part, which doesn't need a
+            // division like wrapping the texel index would.
+            if (address_mode == TEXTURE_ADDRESS_WRAP)
+            {
+                f32 wrapped = coordinate - (f32)FloorToInt(coordinate);
+                return glm::min((int)(wrapped * (f32)size), size - 1);
+            }
+
+            if (address_mode == TEXTURE_ADDRESS_MIRROR)
+            {
+                f32 half = 0.5f * coordinate;
+                f32 wrapped = 2.f * (half - (f32)FloorToInt(half));
+                wrapped = wrapped < 1.f ? wrapped : 2.f - wrapped;
+                return glm::min((int)(wrapped * (f32)size), size - 1);
+            }
+        }
+
+        return glm::clamp(FloorToInt(coordinate * (f32)size), 0, size - 1);
+    }
+
+    template <b32 power_of_two>
+    static void SampleLinearBatch(const Texture& texture, const f32* x, const f32* y, const f32* lod, u32 count, u32* result)
+    {
+        assert(texture.format == format);
+        assert(format != TEXTURE_FORMAT_RGBX32 || texture.levels[0].wide_texels);
+
+        f32 max_lod = (f32)(texture.levels.size() - 1);
+
+        for (u32 i = 0; i < count; i += 4)
+        {
+            // NOTE(achal): Pad the last group of 4 by repeating the last sample.
+            f32 group_x[4], group_y[4];
+            int level0[4], level1[4];
+            u32 weight1[4];
+            b32 needs_level1 = false;
+
+            for (u32 lane = 0; lane < 4; ++lane)
+            {
+                u32 src = glm::min(i + lane, count - 1);
+                group_x[lane] = x[src];
+                group_y[lane] = y[src];
+
+                f32 lane_lod = filter == TEXTURE_FILTER_LINEAR ? 0.f : glm::clamp(lod[src], 0.f, max_lod);
+                if (filter == TEXTURE_FILTER_LINEAR_MIPMAP_NEAREST)
+                    lane_lod = (f32)(int)(lane_lod + 0.5f);
+
+                level0[lane] = (int)lane_lod;
+                level1[lane] = glm::min(level0[lane] + 1, (int)max_lod);
+                weight1[lane] = (u32)((lane_lod - (f32)level0[lane]) * 256.f);
+                needs_level1 |= weight1[lane] != 0;
+            }
+
+            u32 texels0[4];
+            SampleBilinear4<power_of_two>(texture, group_x, group_y, level0, texels0);
+
+            // NOTE(achal): For trilinear, only go to the next level if at least one of the lanes needs it.
+            if (filter == TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR && needs_level1)
+            {
+                u32 texels1[4];
+                SampleBilinear4<power_of_two>(texture, group_x, group_y, level1, texels1);
+                for (u32 lane = 0; lane < 4; ++lane)
+                    texels0[lane] = LerpTexel(texels0[lane], texels1[lane], weight1[lane]);
+            }
+
+            for (u32 lane = 0; lane < 4 && i + lane < count; ++lane)
+                result[i + lane] = texels0[lane];
+        }
+    }
+
+    // Bilinearly filters 4 samples, sample i from levels[level[i]]. The coordinate, weight and address computation
+    // is done for all 4 samples at once, the filtering itself handles 2 texels per register.
+    template <b32 power_of_two>
+    static void SampleBilinear4(const Texture& texture, const f32* x, const f32* y, const int* level, u32* result)
+    {
+        const TextureLevel* lane_levels[4] = { &texture.levels[level[0]], &texture.levels[level[1]],
+            &texture.levels[level[2]], &texture.levels[level[3]] };
+
+        __m128 width_x4 = _mm_setr_ps((f32)lane_levels[0]->width, (f32)lane_levels[1]->width, (f32)lane_levels[2]->width,
+            (f32)lane_levels[3]->width);
+        __m128 height_x4 = _mm_setr_ps((f32)lane_levels[0]->height, (f32)lane_levels[1]->height, (f32)lane_levels[2]->height,
+            (f32)lane_levels[3]->height);
+
+        // NOTE(achal): Texel centers are at half-integer coordinates, so the top-left texel of the 2x2 footprint
+        // is floor(coordinate * size - 0.5).
+        __m128 half = _mm_set1_ps(0.5f);
+        __m128 texel_x = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(x), width_x4), half);
+        __m128 texel_y = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(y), height_x4), half);
+
+        __m128 x0 = Floor(texel_x);
+        __m128 y0 = Floor(texel_y);
+
+        __m128 weight_scale = _mm_set1_ps(256.f);
+        __m128i weight_x = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(texel_x, x0), weight_scale));
+        __m128i weight_y = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(texel_y, y0), weight_scale));
+
+        __m128 one = _mm_set1_ps(1.f);
+        __m128i column0 = AddressLinear4<power_of_two>(x0, width_x4);
+        __m128i column1 = AddressLinear4<power_of_two>(_mm_add_ps(x0, one), width_x4);
+        __m128i row0 = AddressLinear4<power_of_two>(y0, height_x4);
+        __m128i row1 = AddressLinear4<power_of_two>(_mm_add_ps(y0, one), height_x4);
+
+        // NOTE(achal): Same addressing as Texture::GetTexelIndex, split into a row part and a column part. The
+        // multiply by the tile count is done in f32, which is exact for textures of up to 2^24 texels and saves us
+        // SSE4.1's 32-bit multiply.
+        __m128 tile_row_pitch = _mm_setr_ps((f32)(lane_levels[0]->tile_count_x * TEXTURE_TILE_TEXEL_COUNT),
+            (f32)(lane_levels[1]->tile_count_x * TEXTURE_TILE_TEXEL_COUNT), (f32)(lane_levels[2]->tile_count_x * TEXTURE_TILE_TEXEL_COUNT),
+            (f32)(lane_levels[3]->tile_count_x * TEXTURE_TILE_TEXEL_COUNT));
+        row0 = GetTiledRowOffset(row0, tile_row_pitch);
+        row1 = GetTiledRowOffset(row1, tile_row_pitch);
+        column0 = GetTiledColumnOffset(column0);
+        column1 = GetTiledColumnOffset(column1);
+
+        alignas(16) int offset00[4], offset01[4], offset10[4], offset11[4];
+        alignas(16) int lane_weight_x[4], lane_weight_y[4];
+        _mm_store_si128((__m128i*)offset00, _mm_add_epi32(row0, column0));
+        _mm_store_si128((__m128i*)offset01, _mm_add_epi32(row0, column1));
+        _mm_store_si128((__m128i*)offset10, _mm_add_epi32(row1, column0));
+        _mm_store_si128((__m128i*)offset11, _mm_add_epi32(row1, column1));
+        _mm_store_si128((__m128i*)lane_weight_x, weight_x);
+        _mm_store_si128((__m128i*)lane_weight_y, weight_y);
+
+        __m128i full_weight = _mm_set1_epi16(256);
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            // NOTE(achal): Left column texels in a, right column texels in b; the top row in the low halves.
+            __m128i a = FetchWideTexels(*lane_levels[lane], offset00[lane], offset10[lane]);
+            __m128i b = FetchWideTexels(*lane_levels[lane], offset01[lane], offset11[lane]);
+
+            // NOTE(achal): The weights sum to 256, so a * (256 - w) + b * w never exceeds 255 * 256 and the 16-bit
+            // lanes can't overflow.
+            __m128i wx = _mm_set1_epi16((short)lane_weight_x[lane]);
+            __m128i horizontal = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(full_weight, wx)),
+                _mm_mullo_epi16(b, wx)), 8);
+
+            __m128i wy = _mm_set1_epi16((short)lane_weight_y[lane]);
+            __m128i bottom = _mm_unpackhi_epi64(horizontal, horizontal);
+            __m128i filtered = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(horizontal, _mm_sub_epi16(full_weight, wy)),
+                _mm_mullo_epi16(bottom, wy)), 8);
+
+            result[lane] = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(filtered, filtered));
+        }
+    }
+
+    // Maps integer valued texel coordinates, which can be anywhere outside [0, size), into the level.
+    template <b32 power_of_two>
+    inline static __m128i AddressLinear4(__m128 texel, __m128 size)
+    {
+        if (address_mode == TEXTURE_ADDRESS_CLAMP)
+        {
+            __m128 max_texel = _mm_sub_ps(size, _mm_set1_ps(1.f));
+            return _mm_cvttps_epi32(_mm_max_ps(_mm_min_ps(texel, max_texel), _mm_setzero_ps()));
+        }
+
+        if (power_of_two)
+        {
+            // NOTE(achal): Two's complement makes the mask do the right thing for negative coordinates too.
+            __m128i texel_index = _mm_cvttps_epi32(texel);
+            __m128i size_index = _mm_cvttps_epi32(size);
+            if (address_mode == TEXTURE_ADDRESS_WRAP)
+                return _mm_and_si128(texel_index, _mm_sub_epi32(size_index, _mm_set1_epi32(1)));
+
+            // NOTE(achal): Mirror: wrap into [0, 2 * size) and fold the upper half back, min(t, 2 * size - 1 - t).
+            __m128i period_mask = _mm_sub_epi32(_mm_add_epi32(size_index, size_index), _mm_set1_epi32(1));
+            __m128i wrapped = _mm_and_si128(texel_index, period_mask);
+            __m128i folded = _mm_sub_epi32(period_mask, wrapped);
+            __m128i use_folded = _mm_cmplt_epi32(folded, wrapped);
+            return _mm_or_si128(_mm_and_si128(use_folded, folded), _mm_andnot_si128(use_folded, wrapped));
+        }
+
+        if (address_mode == TEXTURE_ADDRESS_WRAP)
+            return _mm_cvttps_epi32(_mm_sub_ps(texel, _mm_mul_ps(size, Floor(_mm_div_ps(texel, size)))));
+
+        __m128 period = _mm_add_ps(size, size);
+        __m128 wrapped = _mm_sub_ps(texel, _mm_mul_ps(period, Floor(_mm_div_ps(texel, period))));
+        __m128 folded = _mm_sub_ps(_mm_sub_ps(period, _mm_set1_ps(1.f)), wrapped);
+        return _mm_cvttps_epi32(_mm_min_ps(wrapped, folded));
+    }
+
+    inline static __m128i GetTiledRowOffset(__m128i y, __m128 tile_row_pitch)
+    {
+        __m128i tile_y = _mm_srli_epi32(y, TEXTURE_TILE_SIZE_LOG2);
+        __m128i tile_rows = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(tile_y), tile_row_pitch));
+        __m128i row_in_tile = _mm_slli_epi32(_mm_and_si128(y, _mm_set1_epi32(TEXTURE_TILE_SIZE - 1)), TEXTURE_TILE_SIZE_LOG2);
+        return _mm_add_epi32(tile_rows, row_in_tile);
+    }
+
+    inline static __m128i GetTiledColumnOffset(__m128i x)
+    {
+        __m128i tile_columns = _mm_slli_epi32(_mm_srli_epi32(x, TEXTURE_TILE_SIZE_LOG2), 2 * TEXTURE_TILE_SIZE_LOG2);
+        __m128i column_in_tile = _mm_and_si128(x, _mm_set1_epi32(TEXTURE_TILE_SIZE - 1));
+        return _mm_add_epi32(tile_columns, column_in_tile);
+    }
+
+    inline static __m128 Floor(__m128 v)
+    {
+        // NOTE(achal): SSE2 has no floor, truncate and fix up the negative non-integers.
+        __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+        return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, v), _mm_set1_ps(1.f)));
+    }
+
+    inline static int FloorToInt(f32 v)
+    {
+        int truncated = (int)v;
+        return truncated - ((f32)truncated > v);
+    }
+
+    // Blends two packed 0x00RRGGBB texels, t is the weight of b in [0, 256].
+    inline static u32 LerpTexel(u32 a, u32 b, u32 t)
+    {
+        u32 a_rb = a & 0xff00ff;
+        u32 a_g = a & 0x00ff00;
+        u32 b_rb = b & 0xff00ff;
+        u32 b_g = b & 0x00ff00;
+
+        u32 rb = (a_rb * (256 - t) + b_rb * t) >> 8;
+        u32 g = (a_g * (256 - t) + b_g * t) >> 8;
+        return (rb & 0xff00ff) | (g & 0x00ff00);
+    }
+};
+
+#define SAMPLER_H
+#endif
@@ -1,11 +1,15 @@
 #ifndef SCENE_H
 
 #include "Core/Types.h"
+#include "ScreenRect.h"
+#include "ZBuffer.h"
 
 #include <glm/glm.hpp>
 
 struct Framebuffer;
-struct ZBuffer;
+struct DirtyTileTracker;
+struct RenderQueue;
+struct OcclusionBuffer;
 
 // NOTE(achal): Triangle Winding Assumption: Anticlock-wise
 //
@@ -24,8 +28,29 @@ struct Scene
 
     virtual void Draw() = 0;
 
+    // NOTE(achal): Draws just the depth of everything Draw would draw, exactly the same depth, so that Draw can
+    // follow with DEPTH_TEST_EQUAL and shade every visible pixel once.
+    virtual void DrawDepth() = 0;
+
+    // NOTE(achal): Draws whatever the scene designates as occluders into the occlusion buffer, before Draw, which then
+    // skips the meshes they hide. Scenes without anything big enough to hide the rest don't designate anything.
+    virtual void DrawOccluders() {}
+
+    // NOTE(achal): Called once every frame after everything's been drawn, the pipelines let go of what they held on
+    // to for meshes that weren't drawn this frame, see Pipeline::EndFrame.
+    virtual void EndFrame() = 0;
+
     virtual void SetFramebuffer(Framebuffer* framebuffer) = 0;
     virtual void SetZBuffer(ZBuffer* z_buffer) = 0;
+    virtual void SetTileTracker(DirtyTileTracker* tile_tracker) = 0;
+    virtual void SetRenderQueue(RenderQueue* render_queue) = 0;
+    virtual void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) = 0;
+    virtual void SetDepthTest(DepthTest depth_test) = 0;
+
+    // NOTE(achal): See Pipeline::viewport and Pipeline::scissor.
+    virtual void SetViewport(const ScreenRect& viewport) = 0;
+    virtual void SetScissor(const ScreenRect& scissor) = 0;
+
     virtual void SetModel(const glm::mat4& model) = 0;
     virtual void SetTime(f32 t) {}
 
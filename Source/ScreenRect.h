@@ -0,0 +1,31 @@
+#ifndef SCREEN_RECT_H
+
+#include "Core/Types.h"
+
+// A rectangle of pixels, [min_x, max_x) x [min_y, max_y).
+struct ScreenRect
+{
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+};
+
+inline b32 IsEmpty(const ScreenRect& rect)
+{
+    return rect.min_x >= rect.max_x || rect.min_y >= rect.max_y;
+}
+
+// The pixels in both a and b, empty if there aren't any.
+inline ScreenRect Intersect(const ScreenRect& a, const ScreenRect& b)
+{
+    ScreenRect result;
+    result.min_x = a.min_x > b.min_x ? a.min_x : b.min_x;
+    result.min_y = a.min_y > b.min_y ? a.min_y : b.min_y;
+    result.max_x = a.max_x < b.max_x ? a.max_x : b.max_x;
+    result.max_y = a.max_y < b.max_y ? a.max_y : b.max_y;
+    return result;
+}
+
+#define SCREEN_RECT_H
+#endif
@@ -0,0 +1,154 @@
+#ifndef SWAP_CHAIN_H
+
+#include "Core/Types.h"
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#define SWAP_CHAIN_MAX_BUFFER_COUNT 3
+
+// NOTE(achal): A ring of 2-3 framebuffers and a present thread which hands every finished frame to a platform
+// supplied callback (blit it to a window, write it to disk, encode it ...). The engine renders frame N+1 into a
+// back buffer while the present thread is still busy with frame N. When all the buffers are in flight,
+// AcquireBackBuffer blocks until the present thread gives one back, so a slow consumer throttles the renderer
+// instead of frames piling up.
+struct SwapChain
+{
+    typedef std::function<void(const void* pixels)> PresentCallback;
+
+    ~SwapChain()
+    {
+        Shutdown();
+    }
+
+    // Returns false, with nothing left allocated, if the buffers couldn't be allocated.
+    b32 Initialize(int width, int height, int channel_count, u32 buffer_count, PresentCallback present_callback)
+    {
+        assert(buffer_count >= 2 && buffer_count <= SWAP_CHAIN_MAX_BUFFER_COUNT);
+
+        this->width = width;
+        this->height = height;
+        this->channel_count = channel_count;
+        this->buffer_count = buffer_count;
+        this->present_callback = std::move(present_callback);
+
+        for (u32 i = 0; i < buffer_count; ++i)
+        {
+            buffers[i] = malloc((size_t)width * (size_t)height * (size_t)channel_count);
+            if (!buffers[i])
+            {
+                for (u32 j = 0; j < i; ++j)
+                {
+                    free(buffers[j]);
+                    buffers[j] = NULL;
+                }
+                free_buffers.clear();
+                return false;
+            }
+            free_buffers.push_back(i);
+        }
+
+        running = true;
+        present_thread = std::thread([this] { PresentLoop(); });
+        return true;
+    }
+
+    // Waits for every queued frame to be presented and stops the present thread.
+    void Shutdown()
+    {
+        if (!present_thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        frame_queued.notify_all();
+        present_thread.join();
+
+        for (u32 i = 0; i < buffer_count; ++i)
+        {
+            free(buffers[i]);
+            buffers[i] = NULL;
+        }
+        free_buffers.clear();
+    }
+
+    // Returns a buffer the caller is free to render into until the next call to Present.
+    void* AcquireBackBuffer()
+    {
+        assert(back_buffer_index == -1);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        buffer_released.wait(lock, [this] { return !free_buffers.empty(); });
+
+        back_buffer_index = (int)free_buffers.front();
+        free_buffers.pop_front();
+        return buffers[back_buffer_index];
+    }
+
+    // Queues the acquired back buffer for presentation and returns without waiting for it.
+    void Present()
+    {
+        assert(back_buffer_index != -1);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued_buffers.push_back((u32)back_buffer_index);
+        }
+        back_buffer_index = -1;
+        frame_queued.notify_one();
+    }
+
+    int width;
+    int height;
+    int channel_count;
+
+private:
+    void PresentLoop()
+    {
+        while (true)
+        {
+            u32 index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frame_queued.wait(lock, [this] { return !running || !queued_buffers.empty(); });
+                if (queued_buffers.empty())
+                    return;
+
+                index = queued_buffers.front();
+                queued_buffers.pop_front();
+            }
+
+            present_callback(buffers[index]);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_buffers.push_back(index);
+            }
+            buffer_released.notify_one();
+        }
+    }
+
+    void* buffers[SWAP_CHAIN_MAX_BUFFER_COUNT] = {};
+    u32 buffer_count = 0;
+    int back_buffer_index = -1;
+
+    std::deque<u32> free_buffers;
+    std::deque<u32> queued_buffers;
+    std::mutex mutex;
+    std::condition_variable frame_queued;
+    std::condition_variable buffer_released;
+    std::thread present_thread;
+    b32 running = false;
+
+    PresentCallback present_callback;
+};
+
+#define SWAP_CHAIN_H
+#endif
@@ -1,42 +1,279 @@
 #ifndef TEXTURE_H
 
 #include "Core/Types.h"
+#include "Core/MappedFile.h"
+#include "TextureCompression.h"
 
 #include <glm/glm.hpp>
+#include <cmath>
+#include <memory>
+#include <vector>
 
+// NOTE(achal): Texels are stored in 4x4 tiles, each tile being 16 consecutive texels in row-major order, and the
+// tiles themselves in row-major order. A 4x4 tile of 32-bit texels is exactly one 64 byte cache line, so walking a
+// texture along a column costs about as much as walking it along a row, no matter how the surface is rotated on
+// screen. Levels are padded up to a whole number of tiles.
+#define TEXTURE_TILE_SIZE_LOG2 2
+#define TEXTURE_TILE_SIZE (1 << TEXTURE_TILE_SIZE_LOG2)
+#define TEXTURE_TILE_TEXEL_COUNT (TEXTURE_TILE_SIZE * TEXTURE_TILE_SIZE)
+
+enum TextureFormat
+{
+    // 32-bit 0x00RRGGBB texels, plus the widened copy for bilinear filtering. See Texture.
+    TEXTURE_FORMAT_RGBX32,
+
+    // One BC1 block per 4x4 tile, see TextureCompression.h. 24 times smaller than RGBX32 and its widened copy.
+    TEXTURE_FORMAT_BC1
+};
+
+// NOTE(achal): The format the textured effects (TextureEffect, WavyEffect) sample. RGBX32, unless the build defines
+// this as TEXTURE_FORMAT_BC1 to trade some quality, BC1 being lossy, for 24 times less texture memory.
+#ifndef EFFECT_TEXTURE_FORMAT
+#define EFFECT_TEXTURE_FORMAT TEXTURE_FORMAT_RGBX32
+#endif
+
+struct TextureLevel
+{
+    int width;
+    int height;
+    int tile_count_x;
+    int tile_count_y;
+    u32* texels;
+
+    // NOTE(achal): Only there after Texture::ExpandTexels.
+    u64* wide_texels;
+
+    // NOTE(achal): Only there after Texture::CompressBC1, which drops texels and wide_texels. Block i encodes tile i.
+    u64* blocks;
+};
+
+// NOTE(achal): Whatever the file had, textures are stored as 32-bit 0x00RRGGBB texels, the same format the
+// framebuffer uses. Sampling a texel is one aligned 32-bit load, and the result can be written out as is. Textures
+// that need to be small rather than fast to sample can be compressed to BC1 once loaded (CompressBC1).
 struct Texture
 {
     int width;
     int height;
-    int channel_count;
+    TextureFormat format;
+
+    // NOTE(achal): If the base level is a power of two in both dimensions, so is every other level, and the
+    // samplers can wrap coordinates with a bit mask.
+    b32 is_power_of_two;
+
+    // NOTE(achal): levels[0] is the base level, every following level is half the size of the previous one
+    // (rounded down, but never less than 1) down to 1x1. All of them live in texel_storage, or in mapped_file for
+    // textures mapped from a container (see TextureContainer.h), in which case texel_storage is empty.
+    std::vector<TextureLevel> levels;
+    std::vector<u32> texel_storage;
+
+    // NOTE(achal): A copy of every level with each texel widened to four 16-bit lanes: blue, green, red and 0 from
+    // the lowest lane up. This is the layout the SSE2 bilinear filter wants, two texels fill a register and can be
+    // weighted with 16-bit multiplies directly, without unpacking bytes on every sample.
+    std::vector<u64> wide_storage;
+
+    std::vector<u64> block_storage;
 
-    // NOTE(achal): stb_image returns a unsigned char*.
-    u8* texels;
+    std::unique_ptr<MappedFile> mapped_file;
 
-    inline u32 GetTexel(f32 x, f32 y, b32 wrap) const
+    // NOTE(achal): Bytes of mapped_file the levels point into, the sections of the one format the texture was mapped
+    // in. The rest of the container never gets paged in.
+    size_t mapped_size = 0;
+
+    // Converts texels as loaded (row-major, channel_count 8-bit channels per texel, like stb_image returns them)
+    // into the tiled 32-bit base level. The source isn't referenced afterwards.
+    void Initialize(const u8* source, int width, int height, int channel_count)
     {
-        int texture_x = 0;
-        int texture_y = 0;
-        if (!wrap)
+        this->width = width;
+        this->height = height;
+        format = TEXTURE_FORMAT_RGBX32;
+        is_power_of_two = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+
+        // NOTE(achal): Storage for the whole mip chain is allocated up front so that GenerateMips doesn't have to
+        // move the base level.
+        TextureLevel level = MakeLevel(width, height);
+        size_t texel_count = GetPaddedTexelCount(level);
+        while (level.width > 1 || level.height > 1)
         {
-            texture_x = glm::min((int)(x * width), width - 1);
-            texture_y = glm::min((int)(y * height), height - 1);
+            level = MakeLevel(glm::max(level.width / 2, 1), glm::max(level.height / 2, 1));
+            texel_count += GetPaddedTexelCount(level);
         }
-        else
+
+        // NOTE(achal): Zero filled, so the padding texels are well defined.
+        texel_storage.assign(texel_count, 0);
+
+        levels.clear();
+        levels.push_back(MakeLevel(width, height));
+        levels[0].texels = texel_storage.data();
+
+        for (int y = 0; y < height; ++y)
         {
-            texture_x = (int)std::fmod(x * width, width - 1);
-            texture_y = (int)std::fmod(y * height, height - 1);
+            for (int x = 0; x < width; ++x)
+            {
+                const u8* src = source + (size_t)channel_count * ((size_t)y * (size_t)width + (size_t)x);
+
+                // NOTE(achal): 1 and 2 channel images are grey (+ alpha), alpha is dropped in every case.
+                u8 red = src[0];
+                u8 green = channel_count >= 3 ? src[1] : src[0];
+                u8 blue = channel_count >= 3 ? src[2] : src[0];
+
+                levels[0].texels[GetTexelIndex(levels[0], x, y)] = (u32)(red << 16 | green << 8 | blue);
+            }
         }
+    }
+
+    // Builds the full mip chain below the base level with a 2x2 box filter.
+    void GenerateMips()
+    {
+        levels.resize(1);
+
+        u32* next_texels = levels[0].texels + GetPaddedTexelCount(levels[0]);
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            const TextureLevel src = levels.back();
+
+            TextureLevel dst = MakeLevel(glm::max(src.width / 2, 1), glm::max(src.height / 2, 1));
+            dst.texels = next_texels;
+            next_texels += GetPaddedTexelCount(dst);
+
+            // NOTE(achal): For odd sized (or 1 texel wide) sources the last row/column gets averaged with itself.
+            for (int y = 0; y < dst.height; ++y)
+            {
+                int y0 = glm::min(2 * y, src.height - 1);
+                int y1 = glm::min(2 * y + 1, src.height - 1);
+                for (int x = 0; x < dst.width; ++x)
+                {
+                    int x0 = glm::min(2 * x, src.width - 1);
+                    int x1 = glm::min(2 * x + 1, src.width - 1);
 
-        u8* texel = texels + (size_t)channel_count * (((size_t)texture_y * (size_t)width) + (size_t)texture_x);
+                    u32 t00 = src.texels[GetTexelIndex(src, x0, y0)];
+                    u32 t01 = src.texels[GetTexelIndex(src, x1, y0)];
+                    u32 t10 = src.texels[GetTexelIndex(src, x0, y1)];
+                    u32 t11 = src.texels[GetTexelIndex(src, x1, y1)];
 
-        u8 red = *texel;
-        u8 green = *(texel + 1);
-        u8 blue = *(texel + 2);
+                    // NOTE(achal): Red and blue, and green on its own, are summed in place. Every channel has
+                    // 8 bits of headroom above it, four 8-bit values never need more than 10.
+                    u32 rb = ((t00 & 0xff00ff) + (t01 & 0xff00ff) + (t10 & 0xff00ff) + (t11 & 0xff00ff) + 0x020002) >> 2;
+                    u32 g = ((t00 & 0x00ff00) + (t01 & 0x00ff00) + (t10 & 0x00ff00) + (t11 & 0x00ff00) + 0x000200) >> 2;
+                    dst.texels[GetTexelIndex(dst, x, y)] = (rb & 0xff00ff) | (g & 0x00ff00);
+                }
+            }
 
-        u32 result = (red << 16 | green << 8 | blue);
+            levels.push_back(dst);
+        }
+    }
+
+    inline static TextureLevel MakeLevel(int width, int height)
+    {
+        TextureLevel result = {};
+        result.width = width;
+        result.height = height;
+        result.tile_count_x = (width + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SIZE_LOG2;
+        result.tile_count_y = (height + TEXTURE_TILE_SIZE - 1) >> TEXTURE_TILE_SIZE_LOG2;
         return result;
     }
+
+    inline static size_t GetPaddedTexelCount(const TextureLevel& level)
+    {
+        return (size_t)level.tile_count_x * (size_t)level.tile_count_y * TEXTURE_TILE_TEXEL_COUNT;
+    }
+
+    // Index of texel (x, y) of the level in the tiled layout.
+    inline static size_t GetTexelIndex(const TextureLevel& level, int x, int y)
+    {
+        size_t tile = (size_t)(y >> TEXTURE_TILE_SIZE_LOG2) * (size_t)level.tile_count_x + (size_t)(x >> TEXTURE_TILE_SIZE_LOG2);
+        size_t texel_in_tile = (size_t)(((y & (TEXTURE_TILE_SIZE - 1)) << TEXTURE_TILE_SIZE_LOG2) | (x & (TEXTURE_TILE_SIZE - 1)));
+        return tile * TEXTURE_TILE_TEXEL_COUNT + texel_in_tile;
+    }
+
+    // Builds wide_texels for every level, call it after GenerateMips. Required by the TEXTURE_FILTER_LINEAR* filters.
+    void ExpandTexels()
+    {
+        size_t texel_count = 0;
+        for (const TextureLevel& level : levels)
+            texel_count += GetPaddedTexelCount(level);
+
+        wide_storage.resize(texel_count);
+
+        u64* next_wide_texels = wide_storage.data();
+        for (TextureLevel& level : levels)
+        {
+            level.wide_texels = next_wide_texels;
+
+            // NOTE(achal): Same tiled layout as texels, so this is a straight copy index for index.
+            size_t level_texel_count = GetPaddedTexelCount(level);
+            for (size_t i = 0; i < level_texel_count; ++i)
+            {
+                u32 texel = level.texels[i];
+                level.wide_texels[i] = (u64)(texel & 0xff) | ((u64)((texel >> 8) & 0xff) << 16) | ((u64)((texel >> 16) & 0xff) << 32);
+            }
+
+            next_wide_texels += level_texel_count;
+        }
+    }
+
+    // Encodes every level as BC1 and releases the uncompressed texels, call it after GenerateMips. Samplers have to
+    // use TEXTURE_FORMAT_BC1 afterwards.
+    void CompressBC1()
+    {
+        EncodeBC1Blocks(&block_storage);
+
+        u64* next_blocks = block_storage.data();
+        for (TextureLevel& level : levels)
+        {
+            level.blocks = next_blocks;
+            level.texels = NULL;
+            level.wide_texels = NULL;
+            next_blocks += (size_t)level.tile_count_x * (size_t)level.tile_count_y;
+        }
+
+        format = TEXTURE_FORMAT_BC1;
+        std::vector<u32>().swap(texel_storage);
+        std::vector<u64>().swap(wide_storage);
+        mapped_file.reset();
+        mapped_size = 0;
+    }
+
+    // Encodes every tile of every level, in order, as the BC1 blocks CompressBC1 would leave the texture with,
+    // without touching the texture.
+    void EncodeBC1Blocks(std::vector<u64>* blocks) const
+    {
+        size_t block_count = 0;
+        for (const TextureLevel& level : levels)
+            block_count += (size_t)level.tile_count_x * (size_t)level.tile_count_y;
+
+        blocks->resize(block_count);
+
+        // NOTE(achal): A tile is 16 consecutive texels in the same order as the texels of a block, so every tile
+        // can be encoded straight from where it sits.
+        u64* next_block = blocks->data();
+        for (const TextureLevel& level : levels)
+        {
+            size_t level_block_count = (size_t)level.tile_count_x * (size_t)level.tile_count_y;
+            for (size_t i = 0; i < level_block_count; ++i)
+                *next_block++ = EncodeBC1Block(level.texels + i * TEXTURE_TILE_TEXEL_COUNT);
+        }
+    }
+
+    // Bytes of texel memory the texture samples from, every level and, unless compressed, both copies of it.
+    inline size_t GetMemorySize() const
+    {
+        // NOTE(achal): Mapped pages are backed by the file and can be dropped by the OS at any time, but the ones the
+        // levels point into are resident while the texture is in use, so they count all the same.
+        return texel_storage.size() * sizeof(u32) + wide_storage.size() * sizeof(u64) +
+            block_storage.size() * sizeof(u64) + mapped_size;
+    }
+
+    // Returns the level of detail for a sample whose texture coordinates change by duv_dx and duv_dy across
+    // one pixel in screen space, i.e. log2 of the longer of the two pixel footprints measured in base level texels.
+    inline f32 ComputeLod(const glm::vec2& duv_dx, const glm::vec2& duv_dy) const
+    {
+        glm::vec2 size((f32)width, (f32)height);
+        f32 footprint_x_sq = glm::dot(duv_dx * size, duv_dx * size);
+        f32 footprint_y_sq = glm::dot(duv_dy * size, duv_dy * size);
+
+        // NOTE(achal): log2(sqrt(a)) = 0.5 * log2(a), saves the square root.
+        return 0.5f * std::log2(glm::max(glm::max(footprint_x_sq, footprint_y_sq), 1e-12f));
+    }
 };
 
 #define TEXTURE_H
@@ -0,0 +1,207 @@
+#ifndef TEXTURE_COMPRESSION_H
+
+#include "Core/Types.h"
+
+#include <glm/glm.hpp>
+#include <utility>
+
+// NOTE(achal): BC1 (DXT1) stores a 4x4 block of texels in 64 bits: two RGB565 endpoint colors in the low 32 bits
+// and a 2-bit palette index per texel in the high 32 bits, texel (x, y) of the block at bits 2 * (4 * y + x). When
+// the first endpoint is greater than the second, the palette is the two endpoints and the two colors 1/3 and 2/3 of
+// the way between them. Otherwise it's the endpoints, their average and black. 4 bits per texel instead of 32.
+
+inline u32 ExpandRGB565(u32 color)
+{
+    u32 red = (color >> 11) & 31;
+    u32 green = (color >> 5) & 63;
+    u32 blue = color & 31;
+
+    // NOTE(achal): Replicate the high bits into the low ones so that 31 and 63 map to 255.
+    red = (red << 3) | (red >> 2);
+    green = (green << 2) | (green >> 4);
+    blue = (blue << 3) | (blue >> 2);
+    return red << 16 | green << 8 | blue;
+}
+
+inline u32 PackRGB565(u32 red, u32 green, u32 blue)
+{
+    return ((red * 31 + 127) / 255) << 11 | ((green * 63 + 127) / 255) << 5 | ((blue * 31 + 127) / 255);
+}
+
+// Decodes a block into 16 packed 0x00RRGGBB texels in row-major order, the layout of a texture tile.
+inline void DecodeBC1Block(u64 block, u32* texels)
+{
+    u32 color0 = (u32)(block & 0xffff);
+    u32 color1 = (u32)((block >> 16) & 0xffff);
+    u32 indices = (u32)(block >> 32);
+
+    u32 palette[4];
+    palette[0] = ExpandRGB565(color0);
+    palette[1] = ExpandRGB565(color1);
+
+    if (color0 > color1)
+    {
+        u32 a_rb = palette[0] & 0xff00ff, a_g = palette[0] & 0x00ff00;
+        u32 b_rb = palette[1] & 0xff00ff, b_g = palette[1] & 0x00ff00;
+
+        // NOTE(achal): Each channel of 2a + b fits in 10 bits, so red and blue can be divided in place. Dividing
+        // by 3 is exact enough as a multiply by 683 / 2048 for numbers that small.
+        u32 rb2 = 2 * a_rb + b_rb, g2 = 2 * a_g + b_g;
+        u32 rb3 = a_rb + 2 * b_rb, g3 = a_g + 2 * b_g;
+        palette[2] = ((((rb2 & 0x3ff) * 683) >> 11) | ((((rb2 >> 16) * 683) >> 11) << 16)) | ((((g2 >> 8) * 683) >> 11) << 8);
+        palette[3] = ((((rb3 & 0x3ff) * 683) >> 11) | ((((rb3 >> 16) * 683) >> 11) << 16)) | ((((g3 >> 8) * 683) >> 11) << 8);
+    }
+    else
+    {
+        palette[2] = (((palette[0] & 0xfefefe) >> 1) + ((palette[1] & 0xfefefe) >> 1));
+        palette[3] = 0;
+    }
+
+    for (int i = 0; i < 16; ++i)
+        texels[i] = palette[(indices >> (2 * i)) & 3];
+}
+
+// Picks the closest palette entry for each of the 16 colors, returns the block and its squared error through error.
+inline u64 MakeBC1Block(const glm::ivec3* colors, u32 color0, u32 color1, int* error)
+{
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    // NOTE(achal): Texels 0 to 3 with indices 0 to 3 decode to the palette.
+    u32 palette[16];
+    DecodeBC1Block((u64)color0 | ((u64)color1 << 16) | ((u64)0xe4 << 32), palette);
+
+    u32 indices = 0;
+    *error = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        int best_index = 0;
+        int best_distance = 0x7fffffff;
+        // NOTE(achal): With both endpoints the same the block is in the 3 color mode, where entry 3 is black. Only
+        // entry 0 is worth considering, the 4 color mode needs color0 > color1.
+        for (int p = 0; p < (color0 == color1 ? 1 : 4); ++p)
+        {
+            glm::ivec3 d = colors[i] - glm::ivec3((palette[p] >> 16) & 0xff, (palette[p] >> 8) & 0xff, palette[p] & 0xff);
+            int distance = d.r * d.r + d.g * d.g + d.b * d.b;
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best_index = p;
+            }
+        }
+        indices |= (u32)best_index << (2 * i);
+        *error += best_distance;
+    }
+
+    return (u64)color0 | ((u64)color1 << 16) | ((u64)indices << 32);
+}
+
+inline u32 PackRGB565(const glm::vec3& color)
+{
+    glm::ivec3 clamped = glm::clamp(glm::ivec3(color + 0.5f), glm::ivec3(0), glm::ivec3(255));
+    return PackRGB565((u32)clamped.r, (u32)clamped.g, (u32)clamped.b);
+}
+
+// Encodes 16 packed 0x00RRGGBB texels in row-major order. The first guess for the endpoints is the corners of the
+// colors' bounding box, inset a little like "Real-Time DXT Compression" (van Waveren) does, along whichever of its
+// diagonals the colors actually follow. Once every texel has picked its palette entry, the endpoints are refit to
+// those picks with least squares, like stb_dxt does, and the refit is kept if it's better. Always uses the 4 color
+// mode.
+inline u64 EncodeBC1Block(const u32* texels)
+{
+    glm::ivec3 colors[16];
+    glm::ivec3 min_color(255), max_color(0), sum(0);
+    for (int i = 0; i < 16; ++i)
+    {
+        colors[i] = glm::ivec3((texels[i] >> 16) & 0xff, (texels[i] >> 8) & 0xff, texels[i] & 0xff);
+        min_color = glm::min(min_color, colors[i]);
+        max_color = glm::max(max_color, colors[i]);
+        sum += colors[i];
+    }
+
+    glm::ivec3 inset = (max_color - min_color) / 16;
+    min_color = glm::min(min_color + inset, glm::ivec3(255));
+    max_color = glm::max(max_color - inset, glm::ivec3(0));
+
+    // NOTE(achal): The bounding box always spans from min to max in green, flip red and/or blue if they fall
+    // as green rises.
+    glm::ivec3 mean = sum / 16;
+    int covariance_rg = 0, covariance_bg = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        glm::ivec3 d = colors[i] - mean;
+        covariance_rg += d.r * d.g;
+        covariance_bg += d.b * d.g;
+    }
+    if (covariance_rg < 0)
+        std::swap(min_color.r, max_color.r);
+    if (covariance_bg < 0)
+        std::swap(min_color.b, max_color.b);
+
+    int error;
+    u64 block = MakeBC1Block(colors, PackRGB565((u32)max_color.r, (u32)max_color.g, (u32)max_color.b),
+        PackRGB565((u32)min_color.r, (u32)min_color.g, (u32)min_color.b), &error);
+    if (error == 0 || (block & 0xffff) == ((block >> 16) & 0xffff))
+        return block;
+
+    // NOTE(achal): Texel i is w_i * color0 + (1 - w_i) * color1 with w_i one of 1, 0, 2/3, 1/3 depending on its
+    // index. Minimizing the squared error over color0 and color1 is a 2x2 linear system, the same for all channels.
+    const f32 weights[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f };
+    f32 aa = 0.f, ab = 0.f, bb = 0.f;
+    glm::vec3 ax(0.f), bx(0.f);
+    for (int i = 0; i < 16; ++i)
+    {
+        f32 a = weights[(block >> (32 + 2 * i)) & 3];
+        f32 b = 1.f - a;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax += a * glm::vec3(colors[i]);
+        bx += b * glm::vec3(colors[i]);
+    }
+
+    f32 determinant = aa * bb - ab * ab;
+    if (determinant == 0.f)
+        return block;
+
+    glm::vec3 refit_color0 = (ax * bb - bx * ab) / determinant;
+    glm::vec3 refit_color1 = (bx * aa - ax * ab) / determinant;
+
+    int refit_error;
+    u64 refit_block = MakeBC1Block(colors, PackRGB565(refit_color0), PackRGB565(refit_color1), &refit_error);
+    return refit_error < error ? refit_block : block;
+}
+
+// NOTE(achal): Must be a power of two. 64 entries of 72 bytes stay well within L1.
+#define BC1_BLOCK_CACHE_SIZE 64
+
+// NOTE(achal): Bilinear filtering touches the same few blocks over and over (4 taps per sample, neighbouring pixels
+// landing in the same blocks), so decoded blocks are kept around in a small direct-mapped cache per thread. Entries
+// are keyed by the block's bits, not its address, since decoding depends on nothing else: nothing can go stale
+// when a texture goes away, identical blocks share an entry, and no thread ever needs to synchronize with another.
+// A zeroed entry is a valid one, block 0 decodes to 16 black texels.
+struct BC1BlockCache
+{
+    inline static const u32* Decode(u64 block)
+    {
+        static thread_local Entry entries[BC1_BLOCK_CACHE_SIZE];
+
+        Entry& entry = entries[(block * 0x9e3779b97f4a7c15ull) >> 58 & (BC1_BLOCK_CACHE_SIZE - 1)];
+        if (entry.block != block)
+        {
+            DecodeBC1Block(block, entry.texels);
+            entry.block = block;
+        }
+        return entry.texels;
+    }
+
+private:
+    struct Entry
+    {
+        u64 block;
+        u32 texels[16];
+    };
+};
+
+#define TEXTURE_COMPRESSION_H
+#endif
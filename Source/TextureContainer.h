@@ -0,0 +1,189 @@
+#ifndef TEXTURE_CONTAINER_H
+
+#include "Core/Types.h"
+#include "Core/MappedFile.h"
+#include "Texture.h"
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// NOTE(achal): The engine's own texture file. It holds a texture exactly as it sits in memory once loaded, in every
+// TextureFormat: the whole mip chain in the tiled 32-bit layout, the same chain widened for the bilinear filter and
+// the chain's BC1 blocks. Mapping it is all it takes to use it in either format, there's no decoding, no mip
+// generation, no compression and no copy, so it's how textures should ship. The offline converter
+// (Tools/TextureConverter) builds one from any image stb_image can read, and TextureManager picks it up in place of
+// the image next to it.
+//
+// Layout, everything little-endian:
+//     TextureContainerHeader
+//     padding up to texel_offset
+//     texel_count u32 texels, every level in order, same as Texture::texel_storage
+//     padding up to wide_texel_offset
+//     texel_count u64 wide texels, same as Texture::wide_storage
+//     padding up to block_offset
+//     block_count u64 BC1 blocks, same as Texture::block_storage
+//
+// Level sizes aren't stored, they follow from width and height the same way Texture::Initialize derives them.
+#define TEXTURE_CONTAINER_MAGIC 0x58545253u // "SRTX"
+#define TEXTURE_CONTAINER_VERSION 2
+#define TEXTURE_CONTAINER_EXTENSION ".srtx"
+
+// NOTE(achal): All three sections start on a cache line, so every 4x4 tile of a mapped texture is one cache line
+// just like it is for a loaded one.
+#define TEXTURE_CONTAINER_ALIGNMENT 64
+
+struct TextureContainerHeader
+{
+    u32 magic;
+    u32 version;
+    u32 width;
+    u32 height;
+
+    // NOTE(achal): HashBytes of the image file the container was built from, so a mapped texture deduplicates
+    // against the same image loaded directly and vice versa.
+    u64 source_hash;
+
+    u64 texel_count;
+    u64 texel_offset;
+    u64 wide_texel_offset;
+
+    u64 block_count;
+    u64 block_offset;
+};
+
+inline u64 AlignTextureContainerOffset(u64 offset)
+{
+    return (offset + TEXTURE_CONTAINER_ALIGNMENT - 1) & ~(u64)(TEXTURE_CONTAINER_ALIGNMENT - 1);
+}
+
+// Writes a texture that has had GenerateMips and ExpandTexels called on it, and its BC1 blocks along with it.
+inline b32 WriteTextureContainer(const char* path, const Texture& texture, u64 source_hash)
+{
+    if (texture.levels.empty() || !texture.levels[0].wide_texels)
+        return false;
+
+    std::vector<u64> blocks;
+    texture.EncodeBC1Blocks(&blocks);
+
+    const TextureLevel& last_level = texture.levels.back();
+    u64 texel_count = (u64)(last_level.texels + Texture::GetPaddedTexelCount(last_level) - texture.levels[0].texels);
+
+    TextureContainerHeader header = {};
+    header.magic = TEXTURE_CONTAINER_MAGIC;
+    header.version = TEXTURE_CONTAINER_VERSION;
+    header.width = (u32)texture.width;
+    header.height = (u32)texture.height;
+    header.source_hash = source_hash;
+    header.texel_count = texel_count;
+    header.texel_offset = AlignTextureContainerOffset(sizeof(header));
+    header.wide_texel_offset = AlignTextureContainerOffset(header.texel_offset + texel_count * sizeof(u32));
+    header.block_count = blocks.size();
+    header.block_offset = AlignTextureContainerOffset(header.wide_texel_offset + texel_count * sizeof(u64));
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return false;
+
+    const u8 padding[TEXTURE_CONTAINER_ALIGNMENT] = {};
+    b32 success = fwrite(&header, sizeof(header), 1, file) == 1;
+    success = success && fwrite(padding, 1, (size_t)(header.texel_offset - sizeof(header)), file) == header.texel_offset - sizeof(header);
+    success = success && fwrite(texture.levels[0].texels, sizeof(u32), (size_t)texel_count, file) == texel_count;
+
+    u64 texel_end = header.texel_offset + texel_count * sizeof(u32);
+    success = success && fwrite(padding, 1, (size_t)(header.wide_texel_offset - texel_end), file) == header.wide_texel_offset - texel_end;
+    success = success && fwrite(texture.levels[0].wide_texels, sizeof(u64), (size_t)texel_count, file) == texel_count;
+
+    u64 wide_texel_end = header.wide_texel_offset + texel_count * sizeof(u64);
+    success = success && fwrite(padding, 1, (size_t)(header.block_offset - wide_texel_end), file) == header.block_offset - wide_texel_end;
+    success = success && fwrite(blocks.data(), sizeof(u64), blocks.size(), file) == blocks.size();
+
+    success = (fclose(file) == 0) && success;
+    return success;
+}
+
+// Maps the container at path into texture, which ends up in format and ready for every sampler of that format. The
+// texel memory belongs to the mapping and is read-only, the texture must not be modified afterwards.
+inline b32 MapTextureContainer(const char* path, TextureFormat format, Texture* texture, u64* source_hash)
+{
+    std::unique_ptr<MappedFile> mapped_file(new MappedFile);
+    if (!mapped_file->Open(path) || mapped_file->size < sizeof(TextureContainerHeader))
+        return false;
+
+    TextureContainerHeader header;
+    memcpy(&header, mapped_file->data, sizeof(header));
+    if (header.magic != TEXTURE_CONTAINER_MAGIC || header.version != TEXTURE_CONTAINER_VERSION || header.width == 0 ||
+        header.height == 0)
+    {
+        return false;
+    }
+
+    int width = (int)header.width;
+    int height = (int)header.height;
+
+    std::vector<TextureLevel> levels;
+    levels.push_back(Texture::MakeLevel(width, height));
+    while (levels.back().width > 1 || levels.back().height > 1)
+        levels.push_back(Texture::MakeLevel(glm::max(levels.back().width / 2, 1), glm::max(levels.back().height / 2, 1)));
+
+    u64 texel_count = 0;
+    u64 block_count = 0;
+    for (const TextureLevel& level : levels)
+    {
+        texel_count += Texture::GetPaddedTexelCount(level);
+        block_count += (u64)level.tile_count_x * (u64)level.tile_count_y;
+    }
+
+    if (header.texel_count != texel_count || header.texel_offset % TEXTURE_CONTAINER_ALIGNMENT ||
+        header.wide_texel_offset % TEXTURE_CONTAINER_ALIGNMENT ||
+        header.texel_offset + texel_count * sizeof(u32) > header.wide_texel_offset ||
+        header.wide_texel_offset + texel_count * sizeof(u64) > header.block_offset ||
+        header.block_count != block_count || header.block_offset % TEXTURE_CONTAINER_ALIGNMENT ||
+        header.block_offset + block_count * sizeof(u64) > mapped_file->size)
+    {
+        return false;
+    }
+
+    u32* texels = (u32*)(mapped_file->data + header.texel_offset);
+    u64* wide_texels = (u64*)(mapped_file->data + header.wide_texel_offset);
+    u64* blocks = (u64*)(mapped_file->data + header.block_offset);
+    for (TextureLevel& level : levels)
+    {
+        // NOTE(achal): Only the section of the format asked for ever gets paged in.
+        if (format == TEXTURE_FORMAT_BC1)
+        {
+            level.blocks = blocks;
+            blocks += (size_t)level.tile_count_x * (size_t)level.tile_count_y;
+        }
+        else
+        {
+            level.texels = texels;
+            level.wide_texels = wide_texels;
+
+            size_t level_texel_count = Texture::GetPaddedTexelCount(level);
+            texels += level_texel_count;
+            wide_texels += level_texel_count;
+        }
+    }
+
+    texture->width = width;
+    texture->height = height;
+    texture->format = format;
+    texture->is_power_of_two = (width & (width - 1)) == 0 && (height & (height - 1)) == 0;
+    texture->levels = std::move(levels);
+    texture->texel_storage.clear();
+    texture->wide_storage.clear();
+    texture->block_storage.clear();
+    texture->mapped_file = std::move(mapped_file);
+    texture->mapped_size = format == TEXTURE_FORMAT_BC1 ? (size_t)block_count * sizeof(u64) :
+        (size_t)texel_count * (sizeof(u32) + sizeof(u64));
+
+    if (source_hash)
+        *source_hash = header.source_hash;
+
+    return true;
+}
+
+#define TEXTURE_CONTAINER_H
+#endif
@@ -1,15 +1,11 @@
 #ifndef TEXTURE_EFFECT_H
 
 #include "Core/Types.h"
-#include "Texture.h"
 #include "DefaultVertexShader.h"
 #include "DefaultGeometryShader.h"
+#include "TexturePixelShader.h"
 
-#include <stb_image/stb_image.h>
 #include <glm/glm.hpp>
-#include <memory>
-
-#define TEXTURE_WRAP 1
 
 struct TextureEffect
 {
@@ -27,23 +23,7 @@ struct TextureEffect
     typedef DefaultVertexShader<Vertex> VertexShader;
     typedef DefaultGeometryShader<VertexShader::VertexOut> GeometryShader;
 
-    struct PixelShader
-    {
-        template <typename Input>
-        u32 operator () (const Input& in) const
-        {
-            assert(texture);
-            return texture->GetTexel(in.texture_coordinates.x, in.texture_coordinates.y, TEXTURE_WRAP);
-        }
-
-        void BindTexture(const char* path)
-        {
-            texture = std::make_unique<Texture>();
-            texture->texels = (u8*)stbi_load(path, &texture->width, &texture->height, &texture->channel_count, 0);
-        }
-
-        std::unique_ptr<Texture> texture = NULL;
-    };
+    typedef TexturePixelShader PixelShader;
 
     VertexShader vertex_shader;
     GeometryShader geometry_shader;
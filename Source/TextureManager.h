@@ -0,0 +1,377 @@
+#ifndef TEXTURE_MANAGER_H
+
+#include "Core/Types.h"
+#include "Core/Hash.h"
+#include "Core/JobPool.h"
+#include "Core/MappedFile.h"
+#include "Texture.h"
+#include "TextureContainer.h"
+
+#include <stb_image/stb_image.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+typedef std::shared_ptr<const Texture> TextureHandle;
+
+// A 1x1 mid grey texture, in the given format, to draw with while the real one is still loading.
+inline const Texture& GetPlaceholderTexture(TextureFormat format)
+{
+    auto make_placeholder = [](TextureFormat format)
+    {
+        const u8 texel[3] = { 0x80, 0x80, 0x80 };
+
+        Texture* texture = new Texture;
+        texture->Initialize(texel, 1, 1, 3);
+        texture->GenerateMips();
+        texture->ExpandTexels();
+        if (format == TEXTURE_FORMAT_BC1)
+            texture->CompressBC1();
+        return texture;
+    };
+
+    static const Texture* rgbx32_placeholder = make_placeholder(TEXTURE_FORMAT_RGBX32);
+    static const Texture* bc1_placeholder = make_placeholder(TEXTURE_FORMAT_BC1);
+    return format == TEXTURE_FORMAT_BC1 ? *bc1_placeholder : *rgbx32_placeholder;
+}
+
+// NOTE(achal): What a pixel shader binds when the texture is loaded in the background (TextureManager::LoadAsync).
+// It starts out pointing at the placeholder texture, the loading job swaps in the real texture once it's ready.
+// Get() is a single atomic load, the pixel shader can call it for every pixel without locking anything, and the
+// first frame drawn after the swap picks up the real texture.
+struct StreamedTexture
+{
+    explicit StreamedTexture(TextureFormat format) : texture(&GetPlaceholderTexture(format))
+    {
+    }
+
+    inline const Texture& Get() const
+    {
+        return *texture.load(std::memory_order_acquire);
+    }
+
+    // Called once, by whoever loaded the texture.
+    void Publish(const TextureHandle& loaded_texture)
+    {
+        // NOTE(achal): The handle has to be in place before the pointer is, so the texture can't be evicted from
+        // under a shader that has just picked it up.
+        handle = loaded_texture;
+        texture.store(handle.get(), std::memory_order_release);
+    }
+
+    std::atomic<const Texture*> texture;
+    TextureHandle handle;
+};
+
+struct TextureManagerStats
+{
+    // Files that actually had to be decoded.
+    u32 decode_count;
+
+    // Textures mapped from a container instead of being decoded.
+    u32 map_count;
+
+    // Loads satisfied by a path that was loaded before, without touching the file.
+    u32 path_hit_count;
+
+    // Loads of a new path whose contents turned out to be identical to an already resident texture.
+    u32 content_hit_count;
+
+    u32 eviction_count;
+
+    u32 resident_texture_count;
+    size_t resident_bytes;
+    size_t peak_resident_bytes;
+};
+
+// NOTE(achal): Owns every texture loaded through it and hands out shared handles. Textures are deduplicated by path
+// first and then by a hash of the file contents, so scenes that bind the same image (under the same or a different
+// path) share one decoded copy. The manager keeps textures resident after their last handle goes away so that a
+// scene switch doesn't decode them again; once the resident set grows past the memory budget, the least recently
+// loaded textures that nobody holds a handle to anymore are evicted. Textures which are still referenced are never
+// evicted, so the budget is a soft limit.
+//
+// If there's a texture container (TextureContainer.h) next to the image, with the same name but the
+// TEXTURE_CONTAINER_EXTENSION extension, it's mapped instead of decoding the image. Nothing checks that the
+// container is newer than the image, rerun the converter after changing one.
+struct TextureManager
+{
+    static TextureManager& Get()
+    {
+        static TextureManager texture_manager;
+        return texture_manager;
+    }
+
+    // Returns a handle to the texture at path, fully mipped and ready for every sampler, or NULL if the file can't
+    // be read or decoded. A texture is loaded once per format it's requested in. Blocks until the texture is loaded;
+    // files are read and decoded without holding the manager's lock, so a slow load doesn't hold up other threads
+    // using the manager.
+    TextureHandle Load(const char* path, TextureFormat format = TEXTURE_FORMAT_RGBX32)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++use_counter;
+
+            auto path_it = path_to_hash.find(path);
+            if (path_it != path_to_hash.end())
+            {
+                TextureHandle texture = FindEntry(GetEntryKey(path_it->second, format));
+                if (texture)
+                {
+                    ++stats.path_hit_count;
+                    return texture;
+                }
+            }
+        }
+
+        std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+        MappedFile file;
+        u64 content_hash;
+        b32 mapped = MapTextureContainer(GetContainerPath(path).c_str(), format, texture.get(), &content_hash);
+        if (!mapped)
+        {
+            if (!file.Open(path))
+                return NULL;
+
+            content_hash = HashBytes(file.data, file.size);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            path_to_hash[path] = content_hash;
+
+            TextureHandle existing_texture = FindEntry(GetEntryKey(content_hash, format));
+            if (existing_texture)
+            {
+                ++stats.content_hit_count;
+                return existing_texture;
+            }
+
+            if (mapped)
+            {
+                ++stats.map_count;
+                return AddEntry(GetEntryKey(content_hash, format), texture);
+            }
+        }
+
+        int width, height, channel_count;
+        u8* texels = (u8*)stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channel_count, 0);
+        if (!texels)
+            return NULL;
+
+        texture->Initialize(texels, width, height, channel_count);
+        stbi_image_free(texels);
+
+        texture->GenerateMips();
+        if (format == TEXTURE_FORMAT_BC1)
+            texture->CompressBC1();
+        else
+            texture->ExpandTexels();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++stats.decode_count;
+        return AddOrFindEntry(GetEntryKey(content_hash, format), texture);
+    }
+
+    // Returns right away with a streamed texture that holds GetPlaceholderTexture() until the texture at path is
+    // loaded on the job pool (see SetJobPool), or for good if it fails to load. Textures which are already resident
+    // are there from the start, and binding a path that is still loading shares the load in flight.
+    std::shared_ptr<StreamedTexture> LoadAsync(const char* path, TextureFormat format = TEXTURE_FORMAT_RGBX32)
+    {
+        std::shared_ptr<StreamedTexture> result = std::make_shared<StreamedTexture>(format);
+        std::string pending_load_key = std::to_string((int)format) + ":" + path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++use_counter;
+
+            auto path_it = path_to_hash.find(path);
+            if (path_it != path_to_hash.end())
+            {
+                TextureHandle texture = FindEntry(GetEntryKey(path_it->second, format));
+                if (texture)
+                {
+                    ++stats.path_hit_count;
+                    result->Publish(texture);
+                    return result;
+                }
+            }
+
+            auto pending_it = pending_loads.find(pending_load_key);
+            if (pending_it != pending_loads.end())
+                return pending_it->second;
+
+            pending_loads[pending_load_key] = result;
+        }
+
+        std::string path_string = path;
+        auto load = [this, path_string, format, pending_load_key, result]()
+        {
+            TextureHandle texture = Load(path_string.c_str(), format);
+            if (texture)
+                result->Publish(texture);
+
+            std::function<void()> callback;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending_loads.erase(pending_load_key);
+                callback = load_callback;
+            }
+
+            if (texture && callback)
+                callback();
+        };
+
+        // NOTE(achal): Nothing waits on a load, it mustn't hold up the frames drawn with the placeholder meanwhile.
+        if (job_pool)
+            job_pool->SubmitBackground(load);
+        else
+            load();
+
+        return result;
+    }
+
+    // The pool LoadAsync loads on. Without one, LoadAsync loads on the calling thread and returns the loaded texture.
+    void SetJobPool(JobPool* job_pool)
+    {
+        this->job_pool = job_pool;
+    }
+
+    // Called on the loading thread whenever LoadAsync has swapped a loaded texture in for the placeholder, after the
+    // swap. For callers that stop rendering while nothing changes, the next frame isn't the same anymore.
+    void SetLoadCallback(const std::function<void()>& callback)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        load_callback = callback;
+    }
+
+    // Path of the texture container that takes the place of the image at path: the same path with the extension
+    // replaced (or appended, if there's none) by TEXTURE_CONTAINER_EXTENSION. A container maps to itself.
+    static std::string GetContainerPath(const char* path)
+    {
+        std::string result = path;
+        size_t separator = result.find_last_of("/\\");
+        size_t dot = result.find_last_of('.');
+        if (dot != std::string::npos && (separator == std::string::npos || dot > separator))
+            result.resize(dot);
+
+        return result + TEXTURE_CONTAINER_EXTENSION;
+    }
+
+    void SetMemoryBudget(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memory_budget = bytes;
+        EvictUnreferenced(memory_budget);
+    }
+
+    // Evicts every texture nobody holds a handle to, regardless of the budget.
+    void Trim()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EvictUnreferenced(0);
+    }
+
+    TextureManagerStats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<Texture> texture;
+        size_t size;
+        u64 last_use;
+    };
+
+    // NOTE(achal): Entries are keyed by the contents of the file and the format they were loaded in.
+    inline static u64 GetEntryKey(u64 content_hash, TextureFormat format)
+    {
+        u32 format_value = (u32)format;
+        return HashBytes(&format_value, sizeof(format_value), content_hash);
+    }
+
+    // Returns the texture with the given key, if it's resident, and marks it as used.
+    TextureHandle FindEntry(u64 key)
+    {
+        auto entry_it = entries.find(key);
+        if (entry_it == entries.end())
+            return NULL;
+
+        entry_it->second.last_use = use_counter;
+        return entry_it->second.texture;
+    }
+
+    // NOTE(achal): For textures loaded without holding the lock. Somebody else might have loaded the same contents
+    // in the meantime, keep theirs so that there's still only one copy.
+    TextureHandle AddOrFindEntry(u64 key, const std::shared_ptr<Texture>& texture)
+    {
+        TextureHandle existing_texture = FindEntry(key);
+        if (existing_texture)
+            return existing_texture;
+
+        return AddEntry(key, texture);
+    }
+
+    TextureHandle AddEntry(u64 key, const std::shared_ptr<Texture>& texture)
+    {
+        Entry entry;
+        entry.texture = texture;
+        entry.size = texture->GetMemorySize();
+        entry.last_use = use_counter;
+        entries[key] = entry;
+
+        ++stats.resident_texture_count;
+        stats.resident_bytes += entry.size;
+        stats.peak_resident_bytes = std::max(stats.peak_resident_bytes, stats.resident_bytes);
+
+        EvictUnreferenced(memory_budget);
+        return texture;
+    }
+
+    // Evicts unreferenced textures, least recently loaded first, until the resident set fits in budget.
+    void EvictUnreferenced(size_t budget)
+    {
+        while (stats.resident_bytes > budget)
+        {
+            auto victim = entries.end();
+            for (auto it = entries.begin(); it != entries.end(); ++it)
+            {
+                if (it->second.texture.use_count() == 1 && (victim == entries.end() || it->second.last_use < victim->second.last_use))
+                    victim = it;
+            }
+
+            if (victim == entries.end())
+                return;
+
+            stats.resident_bytes -= victim->second.size;
+            --stats.resident_texture_count;
+            ++stats.eviction_count;
+
+            // NOTE(achal): Paths that pointed at the evicted texture stay in path_to_hash, a later Load finds no entry
+            // for the hash and loads the file again.
+            entries.erase(victim);
+        }
+    }
+
+    std::unordered_map<std::string, u64> path_to_hash;
+    std::unordered_map<u64, Entry> entries;
+    std::unordered_map<std::string, std::shared_ptr<StreamedTexture>> pending_loads;
+    std::mutex mutex;
+
+    JobPool* job_pool = NULL;
+    std::function<void()> load_callback;
+
+    u64 use_counter = 0;
+    size_t memory_budget = (size_t)256 * 1024 * 1024;
+    TextureManagerStats stats = {};
+};
+
+#define TEXTURE_MANAGER_H
+#endif
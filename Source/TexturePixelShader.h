@@ -0,0 +1,83 @@
+#ifndef TEXTURE_PIXEL_SHADER_H
+
+#include "Core/Types.h"
+#include "Texture.h"
+#include "Sampler.h"
+#include "TextureManager.h"
+
+#include <cassert>
+#include <memory>
+
+// NOTE(achal): The pixel shader of the textured effects: samples the bound texture at the pixel's
+// texture_coordinates, with trilinear filtering and the LOD from the derivatives.
+struct TexturePixelShader
+{
+    typedef Sampler<TEXTURE_ADDRESS_WRAP, TEXTURE_FILTER_LINEAR_MIPMAP_LINEAR, EFFECT_TEXTURE_FORMAT> TextureSampler;
+
+    static const b32 uses_derivatives = true;
+    static const b32 shades_batches = true;
+    static const b32 has_state_signature = true;
+
+    template <typename Input>
+    u32 operator () (const Input& in) const
+    {
+        assert(streamed_texture);
+        const Texture& texture = streamed_texture->Get();
+        return TextureSampler::Sample(texture, in.texture_coordinates.x, in.texture_coordinates.y, 0.f);
+    }
+
+    template <typename Input>
+    u32 operator () (const Input& in, const Input& ddx, const Input& ddy) const
+    {
+        assert(streamed_texture);
+        const Texture& texture = streamed_texture->Get();
+        f32 lod = texture.ComputeLod(ddx.texture_coordinates, ddy.texture_coordinates);
+        return TextureSampler::Sample(texture, in.texture_coordinates.x, in.texture_coordinates.y, lod);
+    }
+
+    template <typename Input>
+    void ShadeBatch(const Input* in, const Input* ddx, const Input* ddy, u32 count, u32 mask, u32* colors) const
+    {
+        assert(streamed_texture);
+        const Texture& texture = streamed_texture->Get();
+
+        // NOTE(achal): Pack the covered pixels together so the texture gets full batches to work on.
+        f32 x[32], y[32], lod[32];
+        u32 texels[32];
+        u32 sample_count = 0;
+        for (u32 i = 0; i < count; ++i)
+        {
+            if ((mask >> i) & 1)
+            {
+                x[sample_count] = in[i].texture_coordinates.x;
+                y[sample_count] = in[i].texture_coordinates.y;
+                lod[sample_count] = texture.ComputeLod(ddx[i].texture_coordinates, ddy[i].texture_coordinates);
+                ++sample_count;
+            }
+        }
+
+        TextureSampler::SampleBatch(texture, x, y, lod, sample_count, texels);
+
+        for (u32 i = 0, sample = 0; i < count; ++i)
+        {
+            if ((mask >> i) & 1)
+                colors[i] = texels[sample++];
+        }
+    }
+
+    // NOTE(achal): The texture currently bound, which changes once the real one replaces the placeholder.
+    u64 GetStateSignature() const
+    {
+        return streamed_texture ? (u64)(uintptr_t)&streamed_texture->Get() : 0;
+    }
+
+    void BindTexture(const char* path)
+    {
+        streamed_texture = TextureManager::Get().LoadAsync(path, TextureSampler::texture_format);
+    }
+
+    std::shared_ptr<StreamedTexture> streamed_texture = NULL;
+};
+
+#define TEXTURE_PIXEL_SHADER_H
+#endif
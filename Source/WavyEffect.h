@@ -3,13 +3,9 @@
 #include "Core/Types.h"
 #include "DefaultVertexShader.h"
 #include "DefaultGeometryShader.h"
-#include "Texture.h"
+#include "TexturePixelShader.h"
 
 #include <glm/glm.hpp>
-#include <cassert>
-#include <memory>
-
-#define TEXTURE_WRAP 1
 
 struct WavyEffect
 {
@@ -28,11 +24,19 @@ struct WavyEffect
     {
         typedef Vertex VertexOut;
 
+        static const b32 transforms_positions = true;
+
+        glm::vec3 TransformPosition(const Vertex& v) const
+        {
+            glm::vec3 position = glm::vec3(model * glm::vec4(v.position, 1.f));
+            position.y += amplitude * glm::sin(time * scroll_frequency + position.x * wave_frequency);
+            return position;
+        }
+
         VertexOut operator () (const Vertex& v)
         {
             VertexOut result;
-            result.position = glm::vec3(model * glm::vec4(v.position, 1.f));
-            result.position.y += amplitude * glm::sin(time * scroll_frequency + result.position.x * wave_frequency);
+            result.position = TransformPosition(v);
             result.texture_coordinates = v.texture_coordinates;
             return result;
         }
@@ -46,23 +50,7 @@ struct WavyEffect
 
     typedef DefaultGeometryShader<VertexShader::VertexOut> GeometryShader;
 
-    struct PixelShader
-    {
-        template <typename Input>
-        u32 operator () (const Input& in) const
-        {
-            assert(texture);
-            return texture->GetTexel(in.texture_coordinates.x, in.texture_coordinates.y, TEXTURE_WRAP);
-        }
-
-        void BindTexture(const char* path)
-        {
-            texture = std::make_unique<Texture>();
-            texture->texels = (u8*)stbi_load(path, &texture->width, &texture->height, &texture->channel_count, 0);
-        }
-
-        std::unique_ptr<Texture> texture = NULL;
-    };
+    typedef TexturePixelShader PixelShader;
 
     VertexShader vertex_shader;
     GeometryShader geometry_shader;
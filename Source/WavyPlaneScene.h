@@ -4,6 +4,7 @@
 #include "Scene.h"
 #include "IndexedTriangleList.h"
 #include "Pipeline.h"
+#include "DepthPipeline.h"
 #include "TextureEffect.h"
 #include "WavyEffect.h"
 #include "Framebuffer.h"
@@ -12,6 +13,7 @@
 struct WavyPlaneScene : public Scene
 {
     typedef Pipeline<WavyEffect> Pipeline;
+    typedef DepthPipeline<WavyEffect> DepthPipeline;
     typedef Pipeline::Vertex Vertex;
 
     WavyPlaneScene()
@@ -88,6 +90,19 @@ struct WavyPlaneScene : public Scene
         pipeline.Draw(it_list);
     }
 
+    void DrawDepth() override
+    {
+        pipeline.effect.vertex_shader.time = time;
+        depth_pipeline.vertex_shader = pipeline.effect.vertex_shader;
+        depth_pipeline.Draw(it_list);
+    }
+
+    void EndFrame() override
+    {
+        pipeline.EndFrame();
+        depth_pipeline.EndFrame();
+    }
+
     void SetFramebuffer(Framebuffer* fb) override
     {
         pipeline.framebuffer = fb;
@@ -96,6 +111,42 @@ struct WavyPlaneScene : public Scene
     void SetZBuffer(ZBuffer* zb) override
     {
         pipeline.z_buffer = zb;
+        depth_pipeline.z_buffer = zb;
+    }
+
+    void SetTileTracker(DirtyTileTracker* tile_tracker) override
+    {
+        pipeline.tile_tracker = tile_tracker;
+        depth_pipeline.tile_tracker = tile_tracker;
+    }
+
+    void SetRenderQueue(RenderQueue* render_queue) override
+    {
+        pipeline.render_queue = render_queue;
+        depth_pipeline.render_queue = render_queue;
+    }
+
+    void SetOcclusionBuffer(OcclusionBuffer* occlusion_buffer) override
+    {
+        pipeline.occlusion_buffer = occlusion_buffer;
+        depth_pipeline.occlusion_buffer = occlusion_buffer;
+    }
+
+    void SetDepthTest(DepthTest depth_test) override
+    {
+        pipeline.depth_test = depth_test;
+    }
+
+    void SetViewport(const ScreenRect& viewport) override
+    {
+        pipeline.viewport = viewport;
+        depth_pipeline.viewport = viewport;
+    }
+
+    void SetScissor(const ScreenRect& scissor) override
+    {
+        pipeline.scissor = scissor;
+        depth_pipeline.scissor = scissor;
     }
 
     void SetModel(const glm::mat4& model) override
@@ -110,6 +161,7 @@ struct WavyPlaneScene : public Scene
 
     IndexedTriangleList<Vertex> it_list;
     Pipeline pipeline;
+    DepthPipeline depth_pipeline;
     f32 time;
 };
 
@@ -1,25 +1,88 @@
 #ifndef Z_BUFFER_H
 
 #include "Core/Types.h"
+#include "ScreenRect.h"
 
+#include <algorithm>
 #include <cassert>
 #include <limits>
 
+enum DepthTest
+{
+    // Passes if nearer than the depth in the buffer, and then replaces it.
+    DEPTH_TEST_LESS,
+
+    // Passes if exactly as near as the depth in the buffer, which stays as it is. For drawing on top of a depth
+    // pre-pass that already laid down the nearest depth of every pixel.
+    DEPTH_TEST_EQUAL
+};
+
 struct ZBuffer
 {
     u32 width;
     u32 height;
     f32* z_values;
 
+    // NOTE(achal): Depth samples per pixel, laid out like the color samples of a Framebuffer.
+    u32 sample_count = 1;
+
     inline void Clear()
     {
-        for (u32 y = 0; y < height; ++y)
+        ScreenRect rect = { 0, 0, (int)width, (int)height };
+        ClearRect(rect, std::numeric_limits<f32>::infinity());
+    }
+
+    inline f32* GetRow(u32 y)
+    {
+        assert(y < height);
+        return z_values + (size_t)y * width * sample_count;
+    }
+
+    // NOTE(achal): Goes through the cache, see Framebuffer::ClearRect.
+    inline void ClearRect(const ScreenRect& rect, f32 z)
+    {
+        assert(rect.min_x >= 0 && (u32)rect.max_x <= width && rect.min_y >= 0 && (u32)rect.max_y <= height);
+        for (int y = rect.min_y; y < rect.max_y; ++y)
         {
-            for (u32 x = 0; x < width; ++x)
-                z_values[y * width + x] = std::numeric_limits<f32>::infinity();
+            f32* row = GetRow((u32)y);
+            std::fill(row + rect.min_x * sample_count, row + rect.max_x * sample_count, z);
         }
     }
 
+    // Depth tests count values in z against row[x, x + count) and writes the ones that pass. Returns a mask with
+    // bit i set if z[i] passed. No bounds checking, count must not be more than 32.
+    inline static u32 TestAndSetSpan(f32* row, u32 x, u32 count, const f32* z)
+    {
+        f32* depth = row + x;
+        u32 mask = 0;
+        for (u32 i = 0; i < count; ++i)
+        {
+            u32 pass = z[i] < depth[i];
+            depth[i] = pass ? z[i] : depth[i];
+            mask |= pass << i;
+        }
+        return mask;
+    }
+
+    // Tests count values in z against row[x, x + count) like TestAndSetSpan or TestEqualSpan, as depth_test says.
+    inline static u32 TestSpan(f32* row, u32 x, u32 count, const f32* z, DepthTest depth_test)
+    {
+        if (depth_test == DEPTH_TEST_EQUAL)
+            return TestEqualSpan(row, x, count, z);
+        return TestAndSetSpan(row, x, count, z);
+    }
+
+    // Returns a mask with bit i set if z[i] is equal to row[x + i], leaves the row alone. No bounds checking, count
+    // must not be more than 32.
+    inline static u32 TestEqualSpan(const f32* row, u32 x, u32 count, const f32* z)
+    {
+        const f32* depth = row + x;
+        u32 mask = 0;
+        for (u32 i = 0; i < count; ++i)
+            mask |= (u32)(z[i] == depth[i]) << i;
+        return mask;
+    }
+
     inline b32 TestAndSet(u32 x, u32 y, f32 z)
     {
         assert(x >= 0 && x < width);
@@ -0,0 +1,73 @@
+// NOTE(achal): Offline converter from any image stb_image can read to the engine's texture container
+// (Source/TextureContainer.h). Build it with Source/ and External/ on the include path and link
+// External/stb_image/stb_image.cpp.
+//
+// Usage: TextureConverter <image> [<image> ...]
+//
+// Every container is written next to its image, the way TextureManager looks for it, e.g.
+// Resources/karasuno.png -> Resources/karasuno.srtx. A container holds the texture both as RGBX32 and as BC1 blocks,
+// so loads in either format map it as is.
+
+#include "Core/Types.h"
+#include "Core/Hash.h"
+#include "Core/MappedFile.h"
+#include "Texture.h"
+#include "TextureContainer.h"
+#include "TextureManager.h"
+
+#include <stb_image/stb_image.h>
+#include <cstdio>
+#include <string>
+
+static b32 ConvertTexture(const char* path)
+{
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        fprintf(stderr, "%s: can't open the file\n", path);
+        return false;
+    }
+
+    int width, height, channel_count;
+    u8* texels = (u8*)stbi_load_from_memory(file.data, (int)file.size, &width, &height, &channel_count, 0);
+    if (!texels)
+    {
+        fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+        return false;
+    }
+
+    Texture texture;
+    texture.Initialize(texels, width, height, channel_count);
+    stbi_image_free(texels);
+
+    texture.GenerateMips();
+    texture.ExpandTexels();
+
+    std::string container_path = TextureManager::GetContainerPath(path);
+    if (!WriteTextureContainer(container_path.c_str(), texture, HashBytes(file.data, file.size)))
+    {
+        fprintf(stderr, "%s: can't write %s\n", path, container_path.c_str());
+        return false;
+    }
+
+    printf("%s -> %s (%dx%d, %d levels)\n", path, container_path.c_str(), width, height, (int)texture.levels.size());
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <image> [<image> ...]\n", argv[0]);
+        return 1;
+    }
+
+    int failure_count = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!ConvertTexture(argv[i]))
+            ++failure_count;
+    }
+
+    return failure_count == 0 ? 0 : 1;
+}